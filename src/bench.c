@@ -0,0 +1,495 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmark harness, a separate program from the solver.
+ *
+ * Compilation :
+ *
+ *  cc -std=c99 -DNDEBUG -Wall -Wextra -Werror -O2 -I. bench.c histo.c solver.c grid.c bitgrid.c bitbatch.c search.c dlx.c perf.c customtypes.c canon.c cache.c -lm -o ./rSudokuBench
+ *
+ * Usage :
+ *
+ * ./rSudokuBench # the 9x9 corpora of ../grids
+ * ./rSudokuBench --iterations 10 --warmup 2 ../grids/hardGrids.txt ../grids/veryHardGrids.txt
+ * ./rSudokuBench --engine dlx --json bench.json
+ * ./rSudokuBench --save-baseline base.txt # before a change
+ * ./rSudokuBench --compare base.txt # after, exit code 2 on a significant slowdown
+ *
+ * Each corpus is loaded in memory, solved warmup times without measure, then iterations times.
+ * Every grid is timed alone with the monotonic clock into a latency histogram (histo.h).
+ * One JSON line by corpus : grids, iterations, solved ratio, throughput in grids/s,
+ * latency min/mean/p50/p90/p99/max in ns and the wall time of each iteration.
+ * A short summary by corpus goes to stderr.
+ *
+ * Regression gate : the wall time of each iteration and the time of each grid_solve stage by iteration
+ * are the samples. --save-baseline writes them, --compare runs a one-sided Mann-Whitney U test
+ * of the run against the baseline, by corpus on the total and by stage. A slowdown is a regression when
+ * p < alpha and the median grows by more than the threshold, for a stage only when it weighs at least
+ * kMinStageShare of the baseline total, the smaller ones are too noisy. 5 iterations at least,
+ * less can not reach p < 0.01.
+ */
+
+// clock_gettime
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "histo.h"
+#include "solver.h"
+#include "timing.h"
+
+static const char *const kDefaultCorpora[] = {
+    "../grids/mediumGrids.txt", "../grids/hardGrids.txt", "../grids/veryHardGrids.txt"
+};
+
+enum {
+    kMaxIterations = 1000,
+    kMaxBaselines = 16, // corpora in a baseline file
+    kBaselineVersion = 1
+};
+
+// stages below this share of the baseline total are not gated
+static const double kMinStageShare = 0.05;
+
+typedef struct
+{
+    char (*grids)[NN + 1];
+    int size, capacity;
+} Corpus;
+
+typedef struct
+{
+    const char *path;
+    int grid_cnt;
+    int iterations;
+    int warmup;
+    long solved_cnt; // over the measured iterations
+    Histo latency;
+    int64_t iteration_ns[kMaxIterations];
+    int64_t stage_ns[kStageCount][kMaxIterations]; // time of each stage by iteration
+} BenchResult;
+
+typedef struct
+{
+    char path[256];
+    int iterations;
+    int64_t iteration_ns[kMaxIterations];
+    int64_t stage_ns[kStageCount][kMaxIterations];
+} Baseline;
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage : %s [options] [corpus ...], default corpora : the 9x9 grids of ../grids\n"
+            " --iterations n      measured runs of each corpus, default 5\n"
+            " --warmup n          runs before measuring, default 1\n"
+            " --engine e          engine for the grids the singles do not solve : color, color+search or dlx\n"
+            " --adaptive          grid_solve adaptive scheduling\n"
+            " --json file         write the results there instead of stdout\n"
+            " --save-baseline f   write the samples of the run as a baseline\n"
+            " --compare f         compare the run with a baseline, exit code 2 on a significant slowdown\n"
+            " --alpha x           significance level of the comparison, default 0.01\n"
+            " --threshold x       median slowdown ignored below x, default 0.10 for 10%%\n",
+            name);
+}
+
+// the grid strings of a file, same reading as rSudokuSolver, the malformed ones are skipped
+// return NA if the file can not be read or if alloc fails
+static int corpus_load(Corpus *corpus, const char *path)
+{
+    corpus->grids = NULL;
+    corpus->size = corpus->capacity = 0;
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return NA;
+    }
+    char scan_fmt[16];
+    snprintf(scan_fmt, sizeof(scan_fmt), " %%%ds", NN * N);
+    static char grid_str[NN * N + 1];
+    int result = 0;
+    while (fscanf(f, scan_fmt, grid_str) == 1) {
+        if (grid_check_str(grid_str) == NA) {
+            continue;
+        }
+        if (corpus->size == corpus->capacity) {
+            int capacity = corpus->capacity ? 2 * corpus->capacity : 256;
+            void *grids = realloc(corpus->grids, capacity * sizeof(*corpus->grids));
+            if (!grids) {
+                result = NA;
+                break;
+            }
+            corpus->grids = grids;
+            corpus->capacity = capacity;
+        }
+        memcpy(corpus->grids[corpus->size++], grid_str, NN + 1);
+    }
+    fclose(f);
+    return result;
+}
+
+static void corpus_free(Corpus *corpus)
+{
+    free(corpus->grids);
+    corpus->grids = NULL;
+    corpus->size = corpus->capacity = 0;
+}
+
+// return NA if alloc fails
+static int bench_corpus(Solver *solver, const Corpus *corpus, BenchResult *br)
+{
+    static char out[NN + 1];
+    SolveResult result;
+    for (int it = 0; it < br->warmup; it++) {
+        for (int i = 0; i < corpus->size; i++) {
+            GUARD(solver_solve(solver, corpus->grids[i], out, &result));
+        }
+    }
+    histo_clear(&br->latency);
+    br->solved_cnt = 0;
+    for (int it = 0; it < br->iterations; it++) {
+        for (int stage = 0; stage < kStageCount; stage++) {
+            br->stage_ns[stage][it] = 0;
+        }
+        const int64_t it_start = timing_now_ns();
+        for (int i = 0; i < corpus->size; i++) {
+            const int64_t start = timing_now_ns();
+            GUARD(solver_solve(solver, corpus->grids[i], out, &result));
+            histo_record(&br->latency, timing_now_ns() - start);
+            br->solved_cnt += (result.status == kSolveSolved);
+            for (int stage = 0; stage < kStageCount; stage++) {
+                br->stage_ns[stage][it] += result.stages[stage].ns;
+            }
+        }
+        br->iteration_ns[it] = timing_now_ns() - it_start;
+    }
+    return 0;
+}
+
+static void bench_print_json(FILE *f, const BenchResult *br)
+{
+    const Histo *h = &br->latency;
+    int64_t total_ns = 0;
+    for (int it = 0; it < br->iterations; it++) {
+        total_ns += br->iteration_ns[it];
+    }
+    const long runs = (long)br->grid_cnt * br->iterations;
+    fprintf(f, "{\"corpus\":\"%s\",\"d\":%d,\"grids\":%d,\"iterations\":%d,\"warmup\":%d,"
+            "\"solved\":%ld,\"solved_ratio\":%.6f,\"throughput\":%.3f,"
+            "\"latency_ns\":{\"min\":%lu,\"mean\":%.1f,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"max\":%lu},"
+            "\"iteration_ns\":[",
+            br->path, D, br->grid_cnt, br->iterations, br->warmup,
+            br->solved_cnt, runs ? (double)br->solved_cnt / runs : 0.,
+            total_ns ? runs * 1e9 / total_ns : 0.,
+            (unsigned long)(h->count ? h->min : 0), histo_mean(h),
+            (unsigned long)histo_percentile(h, 50), (unsigned long)histo_percentile(h, 90),
+            (unsigned long)histo_percentile(h, 99), (unsigned long)h->max);
+    for (int it = 0; it < br->iterations; it++) {
+        fprintf(f, "%s%ld", it == 0 ? "" : ",", (long)br->iteration_ns[it]);
+    }
+    fprintf(f, "]}\n");
+}
+
+static void print_samples(FILE *f, const int64_t *samples, int size)
+{
+    for (int i = 0; i < size; i++) {
+        fprintf(f, " %ld", (long)samples[i]);
+    }
+    fprintf(f, "\n");
+}
+
+// one block by corpus : path and iterations, the iteration times, then one line by stage
+static void baseline_save(FILE *f, const BenchResult *br)
+{
+    fprintf(f, "corpus %s %d\ntotal", br->path, br->iterations);
+    print_samples(f, br->iteration_ns, br->iterations);
+    for (int stage = 0; stage < kStageCount; stage++) {
+        fprintf(f, "%s", grid_stage_name(stage));
+        print_samples(f, br->stage_ns[stage], br->iterations);
+    }
+}
+
+static int read_samples(FILE *f, const char *name, int64_t *samples, int size)
+{
+    char word[32];
+    if (fscanf(f, " %31s", word) != 1 || strcmp(word, name) != 0) {
+        return NA;
+    }
+    for (int i = 0; i < size; i++) {
+        long value;
+        if (fscanf(f, " %ld", &value) != 1) {
+            return NA;
+        }
+        samples[i] = value;
+    }
+    return 0;
+}
+
+// return the number of corpora read, NA if the file is not a baseline of this build
+static int baseline_load(const char *path, Baseline baselines[kMaxBaselines])
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return NA;
+    }
+    int version = 0, d = 0, size = 0;
+    if (fscanf(f, " rsudoku-bench-baseline %d %d", &version, &d) != 2 || version != kBaselineVersion || d != D) {
+        fprintf(stderr, "%s : not a baseline of version %d for D = %d\n", path, kBaselineVersion, D);
+        fclose(f);
+        return NA;
+    }
+    Baseline *bl = &baselines[0];
+    while (size < kMaxBaselines && fscanf(f, " corpus %255s %d", bl->path, &bl->iterations) == 2) {
+        int ret = (bl->iterations < 1 || bl->iterations > kMaxIterations ? NA : 0);
+        if (ret != NA) {
+            ret = read_samples(f, "total", bl->iteration_ns, bl->iterations);
+        }
+        for (int stage = 0; stage < kStageCount && ret != NA; stage++) {
+            ret = read_samples(f, grid_stage_name(stage), bl->stage_ns[stage], bl->iterations);
+        }
+        if (ret == NA) {
+            fprintf(stderr, "%s : corpus %s malformed\n", path, bl->path);
+            fclose(f);
+            return NA;
+        }
+        bl = &baselines[++size];
+    }
+    fclose(f);
+    return size;
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(const int64_t *samples, int size)
+{
+    int64_t sorted[kMaxIterations];
+    memcpy(sorted, samples, size * sizeof(int64_t));
+    qsort(sorted, size, sizeof(int64_t), cmp_int64);
+    return size % 2 ? sorted[size / 2] : (sorted[size / 2 - 1] + sorted[size / 2]) / 2.;
+}
+
+// one-sided Mann-Whitney U test, alternative : the values of b tend to be larger than the ones of a
+// return the p-value, normal approximation with the tie and continuity corrections
+static double mann_whitney_p(const int64_t *a, int n, const int64_t *b, int m)
+{
+    double u = 0;
+    for (int j = 0; j < m; j++) {
+        for (int i = 0; i < n; i++) {
+            u += (b[j] > a[i]) + 0.5 * (b[j] == a[i]);
+        }
+    }
+    // ties : sum of t^3 - t over the groups of equal values
+    int64_t all[2 * kMaxIterations];
+    memcpy(all, a, n * sizeof(int64_t));
+    memcpy(all + n, b, m * sizeof(int64_t));
+    const int total = n + m;
+    qsort(all, total, sizeof(int64_t), cmp_int64);
+    double ties = 0;
+    for (int i = 0, j = 0; i < total; i = j) {
+        while (j < total && all[j] == all[i]) {
+            j++;
+        }
+        double t = j - i;
+        ties += t * t * t - t;
+    }
+    const double mean = n * m / 2.;
+    const double var = n * m / 12. * ((total + 1) - ties / ((double)total * (total - 1)));
+    if (var <= 0) {
+        return 1.;
+    }
+    const double z = (u - mean - 0.5) / sqrt(var);
+    return 0.5 * erfc(z / sqrt(2.));
+}
+
+// report a slowdown of b against a, return 1 if it is a regression
+static int compare_samples(const char *corpus, const char *what, const int64_t *a, int n, const int64_t *b, int m,
+                           double alpha, double threshold, int gated)
+{
+    const double med_a = median(a, n), med_b = median(b, m);
+    const double change = med_a > 0 ? med_b / med_a - 1. : 0.;
+    const double p = mann_whitney_p(a, n, b, m);
+    const int regressed = gated && p < alpha && change > threshold;
+    if (regressed || (p < alpha && change > threshold)) {
+        fprintf(stderr, "%s %s %s : median %.3f ms -> %.3f ms (%+.1f%%) p %.4f\n",
+                regressed ? "regression" : "slower, not gated", corpus, what, med_a / 1e6, med_b / 1e6,
+                100. * change, p);
+    }
+    return regressed;
+}
+
+// return the number of regressions
+static int baseline_compare(const Baseline *bl, const BenchResult *br, double alpha, double threshold)
+{
+    int result = compare_samples(br->path, "total", bl->iteration_ns, bl->iterations,
+                                 br->iteration_ns, br->iterations, alpha, threshold, 1);
+    const double total = median(bl->iteration_ns, bl->iterations);
+    for (int stage = 0; stage < kStageCount; stage++) {
+        const int gated = median(bl->stage_ns[stage], bl->iterations) >= kMinStageShare * total;
+        result += compare_samples(br->path, grid_stage_name(stage), bl->stage_ns[stage], bl->iterations,
+                                  br->stage_ns[stage], br->iterations, alpha, threshold, gated);
+    }
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    SolverOpts opts;
+    solver_default_opts(&opts);
+    int iterations = 5, warmup = 1;
+    const char *json_path = NULL, *save_path = NULL, *compare_path = NULL;
+    double alpha = 0.01, threshold = 0.10;
+    const char **corpora = malloc(argc * sizeof(char *));
+    int corpus_cnt = 0;
+    if (!corpora) {
+        return EXIT_FAILURE;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            int engine = solver_engine_from_name(argv[++i]);
+            if (engine == NA || engine == kEngineSingles) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            opts.routes[kClassMedium] = opts.routes[kClassHard] = engine;
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            opts.adaptive = 1;
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--save-baseline") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            compare_path = argv[++i];
+        } else if (strcmp(argv[i], "--alpha") == 0 && i + 1 < argc) {
+            alpha = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            corpora[corpus_cnt++] = argv[i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (iterations < 1 || iterations > kMaxIterations || warmup < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (corpus_cnt == 0) {
+        corpus_cnt = sizeof(kDefaultCorpora) / sizeof(kDefaultCorpora[0]);
+        memcpy(corpora, kDefaultCorpora, sizeof(kDefaultCorpora));
+    }
+
+    // the baseline struct is large, keep it off the stack
+    static Baseline baselines[kMaxBaselines];
+    int baseline_cnt = 0;
+    if (compare_path && (baseline_cnt = baseline_load(compare_path, baselines)) == NA) {
+        return EXIT_FAILURE;
+    }
+
+    FILE *json = stdout;
+    if (json_path && !(json = fopen(json_path, "w"))) {
+        perror(json_path);
+        return EXIT_FAILURE;
+    }
+    FILE *save = NULL;
+    if (save_path) {
+        if (!(save = fopen(save_path, "w"))) {
+            perror(save_path);
+            return EXIT_FAILURE;
+        }
+        fprintf(save, "rsudoku-bench-baseline %d %d\n", kBaselineVersion, D);
+    }
+
+    // the Solver and BenchResult structs are large, keep them off the stack
+    static Solver solver;
+    static BenchResult br;
+    if (solver_init(&solver, &opts) == NA) {
+        return EXIT_FAILURE;
+    }
+
+    int result = EXIT_SUCCESS, regression_cnt = 0;
+    for (int c = 0; c < corpus_cnt; c++) {
+        Corpus corpus;
+        if (corpus_load(&corpus, corpora[c]) == NA) {
+            result = EXIT_FAILURE;
+            continue;
+        }
+        br.path = corpora[c];
+        br.grid_cnt = corpus.size;
+        br.iterations = iterations;
+        br.warmup = warmup;
+        if (bench_corpus(&solver, &corpus, &br) == NA) {
+            corpus_free(&corpus);
+            result = EXIT_FAILURE;
+            break;
+        }
+        bench_print_json(json, &br);
+        fflush(json);
+        fprintf(stderr, "%s : %d grids x %d, solved %ld, p50 %.1f us p90 %.1f us p99 %.1f us max %.1f us\n",
+                br.path, br.grid_cnt, br.iterations, br.solved_cnt,
+                histo_percentile(&br.latency, 50) / 1e3, histo_percentile(&br.latency, 90) / 1e3,
+                histo_percentile(&br.latency, 99) / 1e3, br.latency.max / 1e3);
+        corpus_free(&corpus);
+
+        if (save) {
+            baseline_save(save, &br);
+        }
+        if (compare_path) {
+            int b = 0;
+            while (b < baseline_cnt && strcmp(baselines[b].path, br.path) != 0) {
+                b++;
+            }
+            if (b == baseline_cnt) {
+                fprintf(stderr, "%s : not in the baseline\n", br.path);
+            } else {
+                regression_cnt += baseline_compare(&baselines[b], &br, alpha, threshold);
+            }
+        }
+    }
+
+    if (save) {
+        fclose(save);
+    }
+    if (compare_path) {
+        fprintf(stderr, "%d regression(s)\n", regression_cnt);
+        if (regression_cnt != 0 && result == EXIT_SUCCESS) {
+            result = 2;
+        }
+    }
+
+    solver_free(&solver);
+    if (json != stdout) {
+        fclose(json);
+    }
+    free(corpora);
+
+    return result;
+}
@@ -0,0 +1,301 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bitbatch.h"
+#include "grid.h"
+
+#include <string.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+static const CandMask kAllCands = (CandMask)(((uint32_t)1 << (N - 1) << 1) - 1);
+
+/*
+ * A vector of one mask by lane. The comparisons return all the bits of a lane set if true, 0 otherwise.
+ * lv_andnot(a, b) is ~a & b, as the instruction.
+ */
+
+#ifdef __AVX2__
+
+typedef __m256i LaneVec;
+
+#if D <= 4
+#define LV_SET1(x) _mm256_set1_epi16((short)(x))
+#define LV_SUB(a, b) _mm256_sub_epi16((a), (b))
+#define LV_EQ(a, b) _mm256_cmpeq_epi16((a), (b))
+#else
+#define LV_SET1(x) _mm256_set1_epi32((int)(x))
+#define LV_SUB(a, b) _mm256_sub_epi32((a), (b))
+#define LV_EQ(a, b) _mm256_cmpeq_epi32((a), (b))
+#endif
+
+static inline LaneVec lv_load(const CandMask *p)
+{
+    return _mm256_loadu_si256((const __m256i *)p);
+}
+
+static inline void lv_store(CandMask *p, LaneVec a)
+{
+    _mm256_storeu_si256((__m256i *)p, a);
+}
+
+static inline LaneVec lv_set1(CandMask m)
+{
+    return LV_SET1(m);
+}
+
+static inline LaneVec lv_and(LaneVec a, LaneVec b)
+{
+    return _mm256_and_si256(a, b);
+}
+
+static inline LaneVec lv_or(LaneVec a, LaneVec b)
+{
+    return _mm256_or_si256(a, b);
+}
+
+static inline LaneVec lv_xor(LaneVec a, LaneVec b)
+{
+    return _mm256_xor_si256(a, b);
+}
+
+static inline LaneVec lv_andnot(LaneVec a, LaneVec b)
+{
+    return _mm256_andnot_si256(a, b);
+}
+
+static inline LaneVec lv_eq(LaneVec a, LaneVec b)
+{
+    return LV_EQ(a, b);
+}
+
+// lanes with at most one bit set
+static inline LaneVec lv_single(LaneVec a)
+{
+    return LV_EQ(_mm256_and_si256(a, LV_SUB(a, LV_SET1(1))), _mm256_setzero_si256());
+}
+
+static inline int lv_any(LaneVec a)
+{
+    return !_mm256_testz_si256(a, a);
+}
+
+#else
+
+typedef struct
+{
+    CandMask m[kBatchLanes];
+} LaneVec;
+
+static inline LaneVec lv_load(const CandMask *p)
+{
+    LaneVec r;
+    for (int l = 0; l < kBatchLanes; l++) {
+        r.m[l] = p[l];
+    }
+    return r;
+}
+
+static inline void lv_store(CandMask *p, LaneVec a)
+{
+    memcpy(p, a.m, sizeof(a.m));
+}
+
+static inline LaneVec lv_set1(CandMask m)
+{
+    LaneVec r;
+    for (int l = 0; l < kBatchLanes; l++) {
+        r.m[l] = m;
+    }
+    return r;
+}
+
+static inline LaneVec lv_and(LaneVec a, LaneVec b)
+{
+    LaneVec r;
+    for (int l = 0; l < kBatchLanes; l++) {
+        r.m[l] = a.m[l] & b.m[l];
+    }
+    return r;
+}
+
+static inline LaneVec lv_or(LaneVec a, LaneVec b)
+{
+    LaneVec r;
+    for (int l = 0; l < kBatchLanes; l++) {
+        r.m[l] = a.m[l] | b.m[l];
+    }
+    return r;
+}
+
+static inline LaneVec lv_xor(LaneVec a, LaneVec b)
+{
+    LaneVec r;
+    for (int l = 0; l < kBatchLanes; l++) {
+        r.m[l] = a.m[l] ^ b.m[l];
+    }
+    return r;
+}
+
+static inline LaneVec lv_andnot(LaneVec a, LaneVec b)
+{
+    LaneVec r;
+    for (int l = 0; l < kBatchLanes; l++) {
+        r.m[l] = (CandMask)~a.m[l] & b.m[l];
+    }
+    return r;
+}
+
+static inline LaneVec lv_eq(LaneVec a, LaneVec b)
+{
+    LaneVec r;
+    for (int l = 0; l < kBatchLanes; l++) {
+        r.m[l] = (CandMask)-(a.m[l] == b.m[l]);
+    }
+    return r;
+}
+
+// lanes with at most one bit set
+static inline LaneVec lv_single(LaneVec a)
+{
+    LaneVec r;
+    for (int l = 0; l < kBatchLanes; l++) {
+        r.m[l] = (CandMask)-((a.m[l] & (a.m[l] - 1)) == 0);
+    }
+    return r;
+}
+
+static inline int lv_any(LaneVec a)
+{
+    CandMask any = 0;
+    for (int l = 0; l < kBatchLanes; l++) {
+        any |= a.m[l];
+    }
+    return any != 0;
+}
+
+#endif // __AVX2__
+
+void bbatch_init(BitBatch *bb)
+{
+    for (int unit = 0; unit < 3 * N; unit++) {
+        for (int i = 0; i < N; i++) {
+            const int cell = unit_cell(unit, i);
+            bb->unit_cells[unit][i] = cell;
+            bb->cell_units[cell][unit / N] = unit;
+        }
+    }
+}
+
+void bbatch_populate(BitBatch *bb, const char *const grid_strs[], int cnt)
+{
+    for (int i = 0; i < NN; i++) {
+        for (int l = 0; l < kBatchLanes; l++) {
+            const int n = (l < cnt ? grid_char_to_int(grid_strs[l][i]) : NA);
+            bb->cands[i][l] = (n == NA ? kAllCands : (CandMask)1 << n);
+        }
+    }
+}
+
+// one round of naked then hidden singles in all the lanes
+// return 1 if a lane changed
+static int bbatch_round(BitBatch *bb)
+{
+    const LaneVec zero = lv_set1(0);
+    LaneVec changed = zero;
+
+    // naked singles : the symbols placed in a unit are removed from its other cells
+    LaneVec placed[3 * N];
+    for (int unit = 0; unit < 3 * N; unit++) {
+        LaneVec acc = zero;
+        for (int i = 0; i < N; i++) {
+            const LaneVec c = lv_load(bb->cands[bb->unit_cells[unit][i]]);
+            acc = lv_or(acc, lv_and(c, lv_single(c)));
+        }
+        placed[unit] = acc;
+    }
+    for (int cell = 0; cell < NN; cell++) {
+        const int *units = bb->cell_units[cell];
+        const LaneVec c = lv_load(bb->cands[cell]);
+        const LaneVec peers = lv_or(lv_or(placed[units[0]], placed[units[1]]), placed[units[2]]);
+        const LaneVec next = lv_andnot(lv_andnot(lv_single(c), peers), c);
+        changed = lv_or(changed, lv_xor(next, c));
+        lv_store(bb->cands[cell], next);
+    }
+
+    // hidden singles : a symbol in one cell only of a unit is placed there
+    for (int unit = 0; unit < 3 * N; unit++) {
+        const int *cells = bb->unit_cells[unit];
+        LaneVec once = zero, twice = zero;
+        for (int i = 0; i < N; i++) {
+            const LaneVec c = lv_load(bb->cands[cells[i]]);
+            twice = lv_or(twice, lv_and(once, c));
+            once = lv_or(once, c);
+        }
+        const LaneVec exactly = lv_andnot(twice, once);
+        if (!lv_any(exactly)) {
+            continue;
+        }
+        for (int i = 0; i < N; i++) {
+            const LaneVec c = lv_load(bb->cands[cells[i]]);
+            const LaneVec hidden = lv_and(c, exactly);
+            const LaneVec none = lv_eq(hidden, zero);
+            const LaneVec next = lv_or(lv_and(none, c), lv_andnot(none, hidden));
+            changed = lv_or(changed, lv_xor(next, c));
+            lv_store(bb->cands[cells[i]], next);
+        }
+    }
+    return lv_any(changed);
+}
+
+unsigned bbatch_solve_singles(BitBatch *bb)
+{
+    while (bbatch_round(bb)) {
+    }
+
+    // solved : one candidate by cell and all the symbols in each unit, so no symbol twice
+    const LaneVec zero = lv_set1(0), all = lv_set1(kAllCands);
+    LaneVec ok = lv_eq(zero, zero);
+    for (int unit = 0; unit < 3 * N; unit++) {
+        LaneVec acc = zero;
+        for (int i = 0; i < N; i++) {
+            const LaneVec c = lv_load(bb->cands[bb->unit_cells[unit][i]]);
+            ok = lv_and(ok, lv_single(c));
+            acc = lv_or(acc, c);
+        }
+        ok = lv_and(ok, lv_eq(acc, all));
+    }
+    CandMask lanes[kBatchLanes];
+    lv_store(lanes, ok);
+    unsigned solved = 0;
+    for (int l = 0; l < kBatchLanes; l++) {
+        solved |= (unsigned)(lanes[l] != 0) << l;
+    }
+    return solved;
+}
+
+void bbatch_get_grid_str(const BitBatch *bb, int lane, char str[NN + 1])
+{
+    for (int i = 0; i < NN; i++) {
+        str[i] = int_to_grid_char(cmask_first(bb->cands[i][lane]));
+    }
+    str[NN] = '\0';
+}
@@ -0,0 +1,58 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITBATCH_H
+#define BITBATCH_H
+
+#include "bitgrid.h"
+#include "consts.h"
+
+/*
+ * Summary:
+ *
+ * The singles fast path of bitgrid.h on a batch of grids at once, for the streams of easy grids where the cost
+ * by grid is the fixed one. The candidates are stored by cell then by lane (structure of arrays) : a cell of all
+ * the grids of the batch is one 256 bits vector, the naked and hidden singles of all the lanes run with the same
+ * instructions, AVX2 if the build enables it (-mavx2 or -march=native), a loop over the lanes otherwise.
+ * No queue and no branch by lane : each round removes the symbols placed from the peers and places the hidden
+ * singles of every unit, until a round changes nothing in any lane. A lane is solved when each cell has one
+ * candidate and each unit all the symbols, the other ones, stalled or invalid, are left to the solver.
+ */
+
+enum {
+    kBatchLanes = 32 / sizeof(CandMask) // grids by batch, 16 for 9x9 and 16x16 grids, 8 for 25x25
+};
+
+typedef struct
+{
+    CandMask cands[NN][kBatchLanes]; // candidates by cell then by lane
+    int unit_cells[3 * N][N]; // cells by unit, as unit_cell
+    int cell_units[NN][3]; // units by cell : row, column, box
+} BitBatch;
+
+void bbatch_init(BitBatch *bb);
+// populate the first cnt lanes from the grid strings, checked before with grid_check_str, the other lanes are empty
+void bbatch_populate(BitBatch *bb, const char *const grid_strs[], int cnt);
+// naked and hidden singles in all the lanes until nothing changes
+// return the lanes solved, bit l set if lane l is
+unsigned bbatch_solve_singles(BitBatch *bb);
+// put the solution of a solved lane in str
+void bbatch_get_grid_str(const BitBatch *bb, int lane, char str[NN + 1]);
+
+#endif // BITBATCH_H
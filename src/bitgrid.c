@@ -0,0 +1,193 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bitgrid.h"
+#include "grid.h"
+
+#include <string.h>
+
+extern inline int cmask_count(CandMask m);
+extern inline int cmask_first(CandMask m);
+extern inline int unit_cell(int unit, int i);
+
+static const CandMask kAllCands = (CandMask)(((uint32_t)1 << (N - 1) << 1) - 1);
+
+int bgrid_populate(BitGrid *bg, const char *grid_str)
+{
+    PRINT_INFO("%s\n", __func__);
+
+    GUARD(grid_check_str(grid_str));
+    for (int i = 0; i < NN; i++) {
+        bg->cands[i] = kAllCands;
+        bg->placed[i] = 0;
+    }
+    bg->placed_size = 0;
+    bg->queue_size = 0;
+
+    for (int i = 0; i < NN; i++) {
+        int n = grid_char_to_int(grid_str[i]);
+        if (n != NA) {
+            GUARD(bgrid_place(bg, i, n));
+        }
+    }
+    return 0;
+}
+
+int bgrid_populate_cands(BitGrid *bg, const char *cands_str)
+{
+    if (strlen(cands_str) != NN * N) {
+        PRINT_INFO("%s invalid size %ld\n", __func__, strlen(cands_str));
+        return NA;
+    }
+    for (int i = 0; i < NN; i++) {
+        CandMask cands = 0;
+        for (int n = 0; n < N; n++) {
+            if (cands_str[i * N + n] != '.') {
+                cands |= (CandMask)1 << n;
+            }
+        }
+        if (cands == 0) {
+            PRINT_INFO("%s invalid grid, no candidate in cell %d\n", __func__, i);
+            return NA;
+        }
+        bg->cands[i] = cands;
+        bg->placed[i] = 0;
+    }
+    bg->placed_size = 0;
+    bg->queue_size = 0;
+
+    for (int i = 0; i < NN; i++) {
+        if (bg->placed[i] == 0 && cmask_count(bg->cands[i]) == 1) {
+            GUARD(bgrid_place(bg, i, cmask_first(bg->cands[i])));
+        }
+    }
+    return 0;
+}
+
+int bgrid_place(BitGrid *bg, int cell, int n)
+{
+    const CandMask bit = (CandMask)1 << n;
+    if (bg->placed[cell] != 0) {
+        return bg->placed[cell] == bit ? 0 : NA;
+    }
+    if (!(bg->cands[cell] & bit)) {
+        PRINT_INFO("%s invalid grid, cell %d\n", __func__, cell);
+        return NA;
+    }
+    bg->cands[cell] = bit;
+    bg->placed[cell] = bit;
+    bg->placed_size++;
+
+    const int row = cell / N, col = cell % N;
+    const int units[3] = { row, N + col, 2 * N + (row / D) * D + col / D };
+    for (int u = 0; u < 3; u++) {
+        for (int i = 0; i < N; i++) {
+            int o_cell = unit_cell(units[u], i);
+            if (o_cell == cell || !(bg->cands[o_cell] & bit)) {
+                continue;
+            }
+            bg->cands[o_cell] &= ~bit;
+            if (bg->cands[o_cell] == 0) {
+                PRINT_INFO("%s invalid grid, no candidate left in cell %d\n", __func__, o_cell);
+                return NA;
+            }
+            if (cmask_count(bg->cands[o_cell]) == 1) {
+                bg->queue[bg->queue_size++] = o_cell;
+            }
+        }
+    }
+    return 0;
+}
+
+// place the cells left with one candidate
+static int bgrid_purge(BitGrid *bg)
+{
+    int result = 0;
+    while (bg->queue_size != 0) {
+        int cell = bg->queue[--bg->queue_size];
+        if (bg->placed[cell] == 0) {
+            GUARD(bgrid_place(bg, cell, cmask_first(bg->cands[cell])));
+            result++;
+        }
+    }
+    return result;
+}
+
+// a symbol with one cell left in a unit is placed there
+static int bgrid_check_hidden_single(BitGrid *bg)
+{
+    int result = 0;
+    for (int unit = 0; unit < 3 * N; unit++) {
+        CandMask once = 0, twice = 0, placed = 0;
+        for (int i = 0; i < N; i++) {
+            int cell = unit_cell(unit, i);
+            if (bg->placed[cell]) {
+                placed |= bg->placed[cell];
+            } else {
+                twice |= once & bg->cands[cell];
+                once |= bg->cands[cell];
+            }
+        }
+        if ((once | placed) != kAllCands) {
+            PRINT_INFO("%s invalid grid, symbol without cell in unit %d\n", __func__, unit);
+            return NA;
+        }
+        const CandMask exactly = once & ~twice & ~placed;
+        if (exactly == 0) {
+            continue;
+        }
+        for (int i = 0; i < N; i++) {
+            int cell = unit_cell(unit, i);
+            CandMask hidden = bg->cands[cell] & exactly;
+            if (bg->placed[cell] || hidden == 0) {
+                continue;
+            }
+            if (cmask_count(hidden) > 1) {
+                PRINT_INFO("%s invalid grid, 2 symbols for cell %d\n", __func__, cell);
+                return NA;
+            }
+            GUARD(bgrid_place(bg, cell, cmask_first(hidden)));
+            result++;
+        }
+    }
+    return result;
+}
+
+int bgrid_solve_singles(BitGrid *bg)
+{
+    int ret = 0;
+    do {
+        GUARD(bgrid_purge(bg));
+        if (bg->placed_size == NN) {
+            break;
+        }
+        ret = bgrid_check_hidden_single(bg);
+        GUARD(ret);
+    } while (ret > 0);
+
+    return bg->placed_size;
+}
+
+void bgrid_get_grid_str(const BitGrid *bg, char str[NN + 1])
+{
+    for (int i = 0; i < NN; i++) {
+        str[i] = (bg->placed[i] == 0 ? '.' : int_to_grid_char(cmask_first(bg->placed[i])));
+    }
+    str[NN] = '\0';
+}
@@ -0,0 +1,108 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITGRID_H
+#define BITGRID_H
+
+#include <stdint.h>
+
+#include "consts.h"
+
+/*
+ * Summary:
+ *
+ * Fast path in front of the color solver, a grid as one candidate bitmask by cell.
+ * Only naked singles and hidden singles are searched for, every elimination comes from a placed symbol
+ * so the state left is fully described by the placed symbols : the grid string of a BitGrid
+ * is the residual to populate a Grid with when the singles are not enough.
+ */
+
+// bit n set if symbol n is a candidate
+#if D <= 4
+typedef uint16_t CandMask;
+#else
+typedef uint32_t CandMask;
+#endif
+
+typedef struct
+{
+    CandMask cands[NN]; // candidates by cell, one bit only for a placed cell
+    CandMask placed[NN]; // symbol placed by cell, 0 if none
+    int placed_size; // the number of cells placed
+    int queue[NN]; // cells with one candidate left not placed yet
+    int queue_size;
+} BitGrid;
+
+// bits set in a mask
+inline int cmask_count(CandMask m)
+{
+#ifdef __GNUC__
+    return __builtin_popcount(m);
+#else
+    int cnt = 0;
+    for (; m; m &= m - 1) {
+        cnt++;
+    }
+    return cnt;
+#endif
+}
+
+// index of the lowest bit set, m must not be 0
+inline int cmask_first(CandMask m)
+{
+#ifdef __GNUC__
+    return __builtin_ctz(m);
+#else
+    int n = 0;
+    while (!(m & 1)) {
+        m >>= 1, n++;
+    }
+    return n;
+#endif
+}
+
+// cell index of the i-th cell of a unit, units are N rows then N columns then N boxes
+inline int unit_cell(int unit, int i)
+{
+    if (unit < N) {
+        return unit * N + i;
+    } else if (unit < 2 * N) {
+        return i * N + (unit - N);
+    }
+    int box = unit - 2 * N;
+    return ((box / D) * D + i / D) * N + (box % D) * D + i % D;
+}
+
+// populate from a grid string, same conventions as grid_populate
+// return NA if string is not of the expected length, for a 9x9 sudoku if the number of clues is < 17
+// and if two clues are in conflict
+int  bgrid_populate(BitGrid *bg, const char *grid_str);
+// populate from a candidates string as returned by grid_get_cands_str, the cells with one candidate are placed
+// return NA if the string is not of the expected length or if the candidates are found invalid
+int  bgrid_populate_cands(BitGrid *bg, const char *cands_str);
+// place symbol n in cell and remove it from the candidates of the peers
+// return NA if it leads to a contradiction
+int  bgrid_place(BitGrid *bg, int cell, int n);
+// naked and hidden singles until nothing changes
+// return the number of cells placed, NN when solved, NA if the grid is found invalid
+int  bgrid_solve_singles(BitGrid *bg);
+// put the placed symbols in str, use '.' for the empty cells
+void bgrid_get_grid_str(const BitGrid *bg, char str[NN + 1]);
+
+#endif // BITGRID_H
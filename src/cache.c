@@ -0,0 +1,157 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// FNV-1a
+static unsigned rcache_bucket(const ResultCache *cache, const uint8_t key[kPackedSize])
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (int i = 0; i < kPackedSize; i++) {
+        h = (h ^ key[i]) * 0x100000001B3ull;
+    }
+    return (unsigned)(h ^ (h >> 32)) & (cache->bucket_cnt - 1);
+}
+
+static void rcache_unlink(ResultCache *cache, int idx)
+{
+    CacheEntry *e = &cache->entries[idx];
+    if (e->prev != NA) {
+        cache->entries[e->prev].next = e->next;
+    } else {
+        cache->head = e->next;
+    }
+    if (e->next != NA) {
+        cache->entries[e->next].prev = e->prev;
+    } else {
+        cache->tail = e->prev;
+    }
+}
+
+static void rcache_push_front(ResultCache *cache, int idx)
+{
+    CacheEntry *e = &cache->entries[idx];
+    e->prev = NA;
+    e->next = cache->head;
+    if (cache->head != NA) {
+        cache->entries[cache->head].prev = idx;
+    } else {
+        cache->tail = idx;
+    }
+    cache->head = idx;
+}
+
+// NOTE: if fails no need to call rcache_free
+int rcache_init(ResultCache *cache, int capacity)
+{
+    cache->capacity = capacity;
+    cache->size = 0;
+    cache->head = cache->tail = NA;
+    cache->lookups = cache->hits = 0;
+    // about one entry by bucket when full
+    cache->bucket_cnt = 1;
+    while (cache->bucket_cnt < capacity) {
+        cache->bucket_cnt *= 2;
+    }
+    cache->entries = malloc(capacity * sizeof(CacheEntry));
+    cache->buckets = malloc(cache->bucket_cnt * sizeof(int));
+    if (!cache->entries || !cache->buckets) {
+        rcache_free(cache);
+        return NA;
+    }
+    memset(cache->buckets, 0xFF, cache->bucket_cnt * sizeof(int));
+    return 0;
+}
+
+void rcache_free(ResultCache *cache)
+{
+    free(cache->entries);
+    free(cache->buckets);
+    cache->entries = NULL;
+    cache->buckets = NULL;
+    cache->capacity = cache->size = 0;
+}
+
+void rcache_clear(ResultCache *cache)
+{
+    if (cache->capacity == 0) {
+        return;
+    }
+    cache->size = 0;
+    cache->head = cache->tail = NA;
+    if (cache->buckets) {
+        memset(cache->buckets, 0xFF, cache->bucket_cnt * sizeof(int));
+    }
+}
+
+static int rcache_lookup(const ResultCache *cache, const uint8_t key[kPackedSize])
+{
+    int idx = cache->buckets[rcache_bucket(cache, key)];
+    while (idx != NA && memcmp(cache->entries[idx].key, key, kPackedSize) != 0) {
+        idx = cache->entries[idx].chain;
+    }
+    return idx;
+}
+
+const CacheValue *rcache_find(ResultCache *cache, const uint8_t key[kPackedSize])
+{
+    cache->lookups++;
+    const int idx = rcache_lookup(cache, key);
+    if (idx == NA) {
+        return NULL;
+    }
+    cache->hits++;
+    rcache_unlink(cache, idx);
+    rcache_push_front(cache, idx);
+    return &cache->entries[idx].value;
+}
+
+void rcache_insert(ResultCache *cache, const uint8_t key[kPackedSize], const CacheValue *value)
+{
+    if (cache->capacity == 0) {
+        return;
+    }
+    int idx = rcache_lookup(cache, key);
+    if (idx != NA) {
+        rcache_unlink(cache, idx);
+    } else {
+        if (cache->size < cache->capacity) {
+            idx = cache->size++;
+        } else {
+            // evict the least recently used, out of its bucket chain
+            idx = cache->tail;
+            rcache_unlink(cache, idx);
+            int *link = &cache->buckets[rcache_bucket(cache, cache->entries[idx].key)];
+            while (*link != idx) {
+                link = &cache->entries[*link].chain;
+            }
+            *link = cache->entries[idx].chain;
+        }
+        CacheEntry *e = &cache->entries[idx];
+        memcpy(e->key, key, kPackedSize);
+        int *bucket = &cache->buckets[rcache_bucket(cache, key)];
+        e->chain = *bucket;
+        *bucket = idx;
+    }
+    cache->entries[idx].value = *value;
+    rcache_push_front(cache, idx);
+}
@@ -0,0 +1,73 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+
+#include "consts.h"
+
+/*
+ * Summary:
+ *
+ * LRU cache of solve results keyed by the canonical form of the grids (canon.h), so that a grid isomorphic
+ * to one solved before is answered without solving : the result is stored in the canonical form and
+ * mapped back by the transform of each grid.
+ * Fixed capacity, allocated once : a chained hash table on the packed keys and a doubly linked list
+ * of the entries, most recently used first, the least recently used is evicted by an insert when full.
+ */
+
+// what is kept of a result
+typedef struct
+{
+    int status, difficulty, engine, solution_cnt, lower_bound; // as in SolveResult
+    uint8_t solution[kPackedSize]; // packed (grid_pack_str), in the canonical form
+} CacheValue;
+
+typedef struct
+{
+    uint8_t key[kPackedSize]; // canonical grid, packed
+    CacheValue value;
+    int prev, next; // LRU list, NA at its ends
+    int chain; // next entry of the same bucket, NA at the end
+} CacheEntry;
+
+typedef struct
+{
+    CacheEntry *entries;
+    int *buckets; // first entry of each bucket, NA if none
+    int capacity, size, bucket_cnt; // bucket_cnt a power of 2
+    int head, tail; // most and least recently used entries, NA if empty
+    long lookups, hits;
+} ResultCache;
+
+// init for capacity entries
+// return NA if alloc fails
+int  rcache_init(ResultCache *cache, int capacity);
+// free the allocated memory
+void rcache_free(ResultCache *cache);
+// drop the entries, the counters are kept, nothing to do for a disabled cache (capacity 0)
+void rcache_clear(ResultCache *cache);
+// the value of a key, which becomes the most recently used, NULL if not found
+const CacheValue *rcache_find(ResultCache *cache, const uint8_t key[kPackedSize]);
+// add or replace the value of a key, evict the least recently used entry if full
+void rcache_insert(ResultCache *cache, const uint8_t key[kPackedSize], const CacheValue *value);
+
+#endif // CACHE_H
@@ -0,0 +1,302 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "canon.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "grid.h"
+
+enum {
+    kRefineRounds = 2,
+    kMaxSegments = 2 * (D + 1) // tie runs : bands, rows of each band, stacks, columns of each stack
+};
+
+// a run of equal keys, its values are permuted
+typedef struct
+{
+    int *values;
+    int size;
+} Segment;
+
+// the grid in one orientation, its keys and the transforms to try
+typedef struct
+{
+    int cells[NN]; // symbol index by cell, NA if empty
+    uint64_t row_keys[N], col_keys[N];
+    int bands[D], stacks[D]; // sorted by key
+    int band_rows[D][D], stack_cols[D][D]; // rows of each band and columns of each stack, sorted by key
+    Segment segments[kMaxSegments];
+    int segment_cnt;
+    long tries; // transforms to try, the product of the factorials of the segment sizes
+} Orientation;
+
+// the smallest form found so far
+typedef struct
+{
+    int found;
+    int values[NN]; // 0 for an empty cell, canonical symbol index + 1 otherwise
+    CanonTransform transform;
+} CanonBest;
+
+// splitmix64 finalizer
+static uint64_t canon_mix(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// color refinement : the key of a row sums the keys of the columns and symbols of its clues, and so on,
+// sums so that the order of the cells does not matter
+static void canon_keys(Orientation *o)
+{
+    uint64_t sym_keys[N], rows[N], cols[N], syms[N];
+    memset(o->row_keys, 0x00, sizeof(o->row_keys));
+    memset(o->col_keys, 0x00, sizeof(o->col_keys));
+    memset(sym_keys, 0x00, sizeof(sym_keys));
+    for (int i = 0; i < NN; i++) {
+        if (o->cells[i] != NA) {
+            o->row_keys[i / N]++;
+            o->col_keys[i % N]++;
+            sym_keys[o->cells[i]]++;
+        }
+    }
+    for (int round = 0; round < kRefineRounds; round++) {
+        for (int k = 0; k < N; k++) {
+            rows[k] = canon_mix(o->row_keys[k]);
+            cols[k] = canon_mix(o->col_keys[k]);
+            syms[k] = canon_mix(sym_keys[k]);
+        }
+        for (int i = 0; i < NN; i++) {
+            const int n = o->cells[i];
+            if (n != NA) {
+                const uint64_t row_key = o->row_keys[i / N], col_key = o->col_keys[i % N];
+                rows[i / N] += canon_mix(col_key + canon_mix(sym_keys[n]));
+                cols[i % N] += canon_mix(row_key + canon_mix(sym_keys[n]));
+                syms[n] += canon_mix(row_key ^ canon_mix(col_key));
+            }
+        }
+        memcpy(o->row_keys, rows, sizeof(rows));
+        memcpy(o->col_keys, cols, sizeof(cols));
+        memcpy(sym_keys, syms, sizeof(syms));
+    }
+}
+
+// sort values by key, insertion sort, the ties stay in increasing order as next_perm needs
+// return the number of tries the ties add as a factor, the runs of ties are added as segments
+static long canon_sort(Orientation *o, int *values, int size, const uint64_t *keys)
+{
+    for (int i = 1; i < size; i++) {
+        const int v = values[i];
+        int j = i - 1;
+        for (; j >= 0 && keys[values[j]] > keys[v]; j--) {
+            values[j + 1] = values[j];
+        }
+        values[j + 1] = v;
+    }
+    long tries = 1;
+    for (int i = 0; i < size;) {
+        int j = i + 1;
+        while (j < size && keys[values[j]] == keys[values[i]]) {
+            j++;
+        }
+        if (j - i > 1) {
+            o->segments[o->segment_cnt].values = values + i;
+            o->segments[o->segment_cnt].size = j - i;
+            o->segment_cnt++;
+            for (int k = 2; k <= j - i; k++) {
+                tries *= k;
+            }
+        }
+        i = j;
+    }
+    return tries;
+}
+
+// the bands (stacks) sorted by the sum of the keys of their rows (columns)
+static void canon_order(Orientation *o)
+{
+    uint64_t band_keys[D] = { 0 }, stack_keys[D] = { 0 };
+    for (int k = 0; k < N; k++) {
+        band_keys[k / D] += canon_mix(o->row_keys[k]);
+        stack_keys[k / D] += canon_mix(o->col_keys[k]);
+    }
+    o->segment_cnt = 0;
+    o->tries = 1;
+    for (int b = 0; b < D; b++) {
+        o->bands[b] = o->stacks[b] = b;
+        for (int i = 0; i < D; i++) {
+            o->band_rows[b][i] = o->stack_cols[b][i] = b * D + i;
+        }
+    }
+    // the keys can not overflow tries : at most D + 1 runs of at most D! each by kind
+    o->tries *= canon_sort(o, o->bands, D, band_keys);
+    o->tries *= canon_sort(o, o->stacks, D, stack_keys);
+    for (int b = 0; b < D && o->tries <= kCanonMaxTries; b++) {
+        o->tries *= canon_sort(o, o->band_rows[b], D, o->row_keys);
+        o->tries *= canon_sort(o, o->stack_cols[b], D, o->col_keys);
+    }
+}
+
+// next permutation in lexicographic order
+// return 0 once back to the first one, the increasing order
+static int next_perm(int *values, int size)
+{
+    int i = size - 2;
+    while (i >= 0 && values[i] >= values[i + 1]) {
+        i--;
+    }
+    if (i >= 0) {
+        int j = size - 1;
+        while (values[j] <= values[i]) {
+            j--;
+        }
+        int tmp = values[i];
+        values[i] = values[j], values[j] = tmp;
+    }
+    for (int l = i + 1, r = size - 1; l < r; l++, r--) {
+        int tmp = values[l];
+        values[l] = values[r], values[r] = tmp;
+    }
+    return i >= 0;
+}
+
+// the form of a transform, kept if smaller than the best one, compared as it is built
+static void canon_try(const Orientation *o, int transposed, CanonBest *best)
+{
+    int rows[N], cols[N], labels[N], values[NN];
+    for (int b = 0; b < D; b++) {
+        for (int i = 0; i < D; i++) {
+            rows[b * D + i] = o->band_rows[o->bands[b]][i];
+            cols[b * D + i] = o->stack_cols[o->stacks[b]][i];
+        }
+    }
+    for (int n = 0; n < N; n++) {
+        labels[n] = NA;
+    }
+    int label_cnt = 0, smaller = !best->found;
+    for (int i = 0; i < NN; i++) {
+        const int n = o->cells[rows[i / N] * N + cols[i % N]];
+        int v = 0;
+        if (n != NA) {
+            if (labels[n] == NA) {
+                labels[n] = label_cnt++;
+            }
+            v = labels[n] + 1;
+        }
+        if (!smaller) {
+            if (v > best->values[i]) {
+                return;
+            }
+            smaller = (v < best->values[i]);
+        }
+        values[i] = v;
+    }
+    if (!smaller) {
+        return;
+    }
+    // the symbols without clue get the labels left
+    for (int n = 0; n < N; n++) {
+        if (labels[n] == NA) {
+            labels[n] = label_cnt++;
+        }
+    }
+    best->found = 1;
+    memcpy(best->values, values, sizeof(values));
+    best->transform.transposed = transposed;
+    memcpy(best->transform.rows, rows, sizeof(rows));
+    memcpy(best->transform.cols, cols, sizeof(cols));
+    memcpy(best->transform.labels, labels, sizeof(labels));
+}
+
+int canon_grid(const char *grid_str, char canon_str[NN + 1], CanonTransform *transform)
+{
+    if (strlen(grid_str) != NN) {
+        return NA;
+    }
+    Orientation orientations[2];
+    long tries = 0;
+    for (int t = 0; t < 2; t++) {
+        Orientation *o = &orientations[t];
+        for (int r = 0; r < N; r++) {
+            for (int c = 0; c < N; c++) {
+                o->cells[r * N + c] = grid_char_to_int(grid_str[t ? c * N + r : r * N + c]);
+            }
+        }
+        canon_keys(o);
+        canon_order(o);
+        tries += o->tries;
+    }
+    if (tries > kCanonMaxTries) {
+        return NA;
+    }
+
+    CanonBest best;
+    best.found = 0;
+    for (int t = 0; t < 2; t++) {
+        Orientation *o = &orientations[t];
+        int more = 1;
+        while (more) {
+            canon_try(o, t, &best);
+            // odometer : a segment back to its first permutation moves the next one
+            more = 0;
+            for (int s = 0; s < o->segment_cnt && !more; s++) {
+                more = next_perm(o->segments[s].values, o->segments[s].size);
+            }
+        }
+    }
+    for (int i = 0; i < NN; i++) {
+        canon_str[i] = (best.values[i] == 0 ? '.' : int_to_grid_char(best.values[i] - 1));
+    }
+    canon_str[NN] = '\0';
+    *transform = best.transform;
+    return 0;
+}
+
+// cell of the grid at row i and column j of the canonical form
+static int canon_cell(const CanonTransform *transform, int i, int j)
+{
+    const int r = transform->rows[i], c = transform->cols[j];
+    return transform->transposed ? c * N + r : r * N + c;
+}
+
+void canon_apply(const CanonTransform *transform, const char *grid_str, char out[NN + 1])
+{
+    for (int i = 0; i < NN; i++) {
+        const int n = grid_char_to_int(grid_str[canon_cell(transform, i / N, i % N)]);
+        out[i] = (n == NA ? '.' : int_to_grid_char(transform->labels[n]));
+    }
+    out[NN] = '\0';
+}
+
+void canon_revert(const CanonTransform *transform, const char *canon_str, char out[NN + 1])
+{
+    int symbols[N];
+    for (int n = 0; n < N; n++) {
+        symbols[transform->labels[n]] = n;
+    }
+    for (int i = 0; i < NN; i++) {
+        const int n = grid_char_to_int(canon_str[i]);
+        out[canon_cell(transform, i / N, i % N)] = (n == NA ? '.' : int_to_grid_char(symbols[n]));
+    }
+    out[NN] = '\0';
+}
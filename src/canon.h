@@ -0,0 +1,62 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CANON_H
+#define CANON_H
+
+#include "consts.h"
+
+/*
+ * Summary:
+ *
+ * Canonical form of a grid under the sudoku symmetries : symbol relabeling, rows permuted in their band,
+ * bands permuted, columns in their stack, stacks permuted, transposition. Isomorphic grids have the same
+ * canonical form, so a result found for one is the result of all of them (cache.h).
+ *
+ * The canonical form is the smallest grid string, empty cells first then the symbols relabeled in order
+ * of first appearance, over a set of transforms fixed by invariants : rows, columns and symbols get keys
+ * by color refinement (clue counts, then two rounds of hashes of the keys of the cells they meet), the
+ * bands and stacks the sum of the keys of their rows or columns, and the transforms tried are the ones
+ * sorting bands, rows, stacks and columns by key, in both orientations. Only the ties are permuted :
+ * a few transforms for most grids, and a grid with too many ties (very symmetric, almost empty) is not
+ * canonicalized, see kCanonMaxTries.
+ */
+
+enum {
+    kCanonMaxTries = 4096 // transforms tried by grid, above that canon_grid gives up
+};
+
+// from a grid to its canonical form
+typedef struct
+{
+    int transposed; // the grid is transposed first
+    int rows[N]; // row i of the canonical form is row rows[i] of the grid, transposed first if transposed
+    int cols[N]; // same for the columns
+    int labels[N]; // symbol index in the canonical form of each symbol index of the grid
+} CanonTransform;
+
+// canonical form of a grid string and the transform mapping the grid to it
+// return NA if the string is not of the expected length or if more than kCanonMaxTries transforms would be tried
+int  canon_grid(const char *grid_str, char canon_str[NN + 1], CanonTransform *transform);
+// apply a transform to a grid string of the same grid, a solution : empty cells as '.'
+void canon_apply(const CanonTransform *transform, const char *grid_str, char out[NN + 1]);
+// the inverse, from the canonical form back to the grid
+void canon_revert(const CanonTransform *transform, const char *canon_str, char out[NN + 1]);
+
+#endif // CANON_H
@@ -27,12 +27,17 @@
 //#define CHECK_GRID
 //#endif
 
+// count the IntVec allocations, bytes and high-water mark, and report them with the resident set size
+//#ifndef MEM_STATS
+//#define MEM_STATS
+//#endif
+
 // set to != 0 to print error/debug/info msgs
 #ifndef DO_PRINT_INFO
 #define DO_PRINT_INFO 0
 #endif
 
-// for 9x9 sudoku : ser D to 3, for 16x16 set D to 4
+// for 9x9 sudoku : ser D to 3, for 16x16 set D to 4, for 25x25 set D to 5
 #ifndef D
 #define D 3
 #endif
@@ -56,6 +61,22 @@ enum {
     NN = (D * D) * (D * D)
 };
 
+#if D < 2 || D > 5
+#error "D must be in [2, 5]"
+#endif
+
+// first capacity of an IntVec, most of them hold a few values only,
+// kept small so that the N * NN sized maps stay reasonable for D = 5
+enum {
+    kIVecInitCapacity = (N < 8 ? N : 8)
+};
+
+// packed grid : one cell stored on kCellBits bits, 0 for an empty cell, value + 1 otherwise
+enum {
+    kCellBits = (N < 16 ? 4 : 5),
+    kPackedSize = (NN * kCellBits + 7) / 8
+};
+
 // unit : cell, col, row, box
 enum {
     kUnitCount = 4,
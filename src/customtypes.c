@@ -17,6 +17,13 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifdef MEM_STATS
+// sysconf
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
 #include "customtypes.h"
 
 // internal : map color to internal idx for *Map structs
@@ -64,6 +71,8 @@ extern inline int  *ivec_ptr_at_idx(IntVec *vec, int idx);
 extern inline int  ivec_copy(const IntVec *src, IntVec *dst);
 // return the size of the array
 extern inline int  ivec_size(const IntVec *vec);
+// return the bytes held by the storage
+extern inline long ivec_mem_bytes(const IntVec *vec);
 // internal : alloc storage, return NA if alloc fails
 extern inline int  ivec_alloc_store(IntVec *vec);
 
@@ -89,3 +98,48 @@ extern inline int  cvmap_insert_one(ColorVecMap *cvm, const Color c, int value);
 // copy from src to dst, src and dst must be initialized, alloc if necessary
 // return NA if alloc fails
 extern inline int  cvmap_copy(const ColorVecMap *src, ColorVecMap *dst);
+// return the bytes held by the storage of the keys and of the values
+extern inline long cvmap_mem_bytes(const ColorVecMap *cvm);
+
+#ifdef MEM_STATS
+
+// MemStats : opt-in accounting of the IntVec stores, by thread
+
+#ifdef __GNUC__
+__thread MemStats mem_stats;
+#else
+MemStats mem_stats;
+#endif
+
+// internal : count an alloc of new_bytes replacing old_bytes, new_bytes 0 for a free
+extern inline void mem_stats_account(long old_bytes, long new_bytes);
+
+void mem_stats_begin(MemStats *start)
+{
+    mem_stats.peak_bytes = mem_stats.live_bytes;
+    *start = mem_stats;
+}
+
+void mem_stats_end(const MemStats *start, MemStats *delta)
+{
+    delta->alloc_cnt = mem_stats.alloc_cnt - start->alloc_cnt;
+    delta->alloc_bytes = mem_stats.alloc_bytes - start->alloc_bytes;
+    delta->live_bytes = mem_stats.live_bytes - start->live_bytes;
+    delta->peak_bytes = mem_stats.peak_bytes - start->live_bytes;
+}
+
+long mem_rss_bytes(void)
+{
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) {
+        return NA;
+    }
+    long size = 0, resident = NA;
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2) {
+        resident = NA;
+    }
+    fclose(f);
+    return resident == NA ? NA : resident * sysconf(_SC_PAGESIZE);
+}
+
+#endif // MEM_STATS
@@ -36,6 +36,54 @@ inline int color_to_idx(Color color)
 
 /*****************************************************************/
 
+#ifdef MEM_STATS
+
+// counters of the IntVec stores, by thread
+typedef struct
+{
+    long alloc_cnt; // malloc and realloc
+    long alloc_bytes; // bytes asked for by them, a realloc counts its full new size
+    long live_bytes; // bytes held
+    long peak_bytes; // high-water mark of live_bytes since the last mem_stats_begin
+} MemStats;
+
+#ifdef __GNUC__
+extern __thread MemStats mem_stats;
+#else
+extern MemStats mem_stats;
+#endif
+
+inline void mem_stats_account(long old_bytes, long new_bytes)
+{
+    if (new_bytes != 0) {
+        mem_stats.alloc_cnt++;
+        mem_stats.alloc_bytes += new_bytes;
+    }
+    mem_stats.live_bytes += new_bytes - old_bytes;
+    if (mem_stats.live_bytes > mem_stats.peak_bytes) {
+        mem_stats.peak_bytes = mem_stats.live_bytes;
+    }
+}
+
+#define MEM_ACCOUNT(old_bytes, new_bytes) mem_stats_account(old_bytes, new_bytes)
+
+// start a measure : keep the counters in start, the high-water mark restarts from the bytes held
+void mem_stats_begin(MemStats *start);
+// the counters since start in delta, live_bytes is the growth and peak_bytes the high-water mark over the bytes held
+// at start
+void mem_stats_end(const MemStats *start, MemStats *delta);
+// resident set size of the process from /proc/self/statm
+// return NA if not available
+long mem_rss_bytes(void);
+
+#else
+
+#define MEM_ACCOUNT(old_bytes, new_bytes) ((void)(old_bytes), (void)(new_bytes))
+
+#endif // MEM_STATS
+
+/*****************************************************************/
+
 typedef struct
 {
     int store[2][2 * N * NN + 1];
@@ -90,6 +138,7 @@ inline void ivec_clear(IntVec *vec)
 inline void ivec_free(IntVec *vec)
 {
     if (vec->store != NULL) {
+        MEM_ACCOUNT((long)vec->capacity * sizeof(int), 0);
         free(vec->store);
         vec->store = NULL;
     }
@@ -99,10 +148,12 @@ inline int ivec_alloc_store(IntVec *vec)
 {
     int ret = 0;
     if (vec->capacity == 0) {
-        vec->capacity = N;
+        vec->capacity = kIVecInitCapacity;
         vec->store = malloc(vec->capacity * sizeof(int));
         if (!vec->store) {
             ret = NA;
+        } else {
+            MEM_ACCOUNT(0, (long)vec->capacity * sizeof(int));
         }
     } else {
         vec->capacity *= 2;
@@ -111,6 +162,8 @@ inline int ivec_alloc_store(IntVec *vec)
         if (!vec->store) {
             vec->store = old_store;
             ret = NA;
+        } else {
+            MEM_ACCOUNT(old_store ? (long)vec->capacity / 2 * sizeof(int) : 0, (long)vec->capacity * sizeof(int));
         }
     }
     return ret;
@@ -188,6 +241,7 @@ inline int *ivec_ptr_at_idx(IntVec *vec, int idx)
 inline int ivec_copy(const IntVec *src, IntVec *dst)
 {
     if (dst->capacity < src->size) {
+        const long old_bytes = (dst->store ? (long)dst->capacity * sizeof(int) : 0);
         dst->capacity = src->size;
         int *old_store = dst->store;
         dst->store = realloc(dst->store, dst->capacity * sizeof(int));
@@ -195,6 +249,7 @@ inline int ivec_copy(const IntVec *src, IntVec *dst)
             dst->store = old_store;
             return NA;
         }
+        MEM_ACCOUNT(old_bytes, (long)dst->capacity * sizeof(int));
     }
     if (src->size && src->store) {
         dst->store = memcpy(dst->store, src->store, src->size * sizeof(int));
@@ -208,19 +263,24 @@ inline int ivec_size(const IntVec *vec)
     return vec->size;
 }
 
+inline long ivec_mem_bytes(const IntVec *vec)
+{
+    return vec->store ? (long)vec->capacity * sizeof(int) : 0;
+}
+
 /*****************************************************************/
 
 typedef struct
 {
     IntVec list;
-    int marked[2 * N * NN + 1];
+    uint8_t marked[2 * N * NN + 1];
     IntVec store[2 * N * NN + 1];
 } ColorVecMap;
 
 inline void cvmap_init(ColorVecMap *cvm)
 {
     ivec_init(&cvm->list);
-    memset(cvm->marked, 0x00, (2 * N * NN + 1) * sizeof(int));
+    memset(cvm->marked, 0x00, (2 * N * NN + 1) * sizeof(uint8_t));
     for (int i = 0; i < 2 * N * NN + 1; i++) {
         ivec_init(&cvm->store[i]);
     }
@@ -229,7 +289,7 @@ inline void cvmap_init(ColorVecMap *cvm)
 inline void cvmap_clear(ColorVecMap *cvm)
 {
     ivec_clear(&cvm->list);
-    memset(cvm->marked, 0x00, (2 * N * NN + 1) * sizeof(int));
+    memset(cvm->marked, 0x00, (2 * N * NN + 1) * sizeof(uint8_t));
     for (int i = 0; i < 2 * N * NN + 1; i++) {
         ivec_clear(&cvm->store[i]);
     }
@@ -260,16 +320,17 @@ inline void cvmap_erase(ColorVecMap *cvm, const Color c)
     cvm->marked[color_to_idx(c)] = 0;
 }
 
+// the keys erased are removed from the list in one pass, the order is kept
 inline const IntVec *cvmap_keys(ColorVecMap *cvm)
 {
-    for (int i = 0; i < cvm->list.size;) {
-        int idx = color_to_idx(ivec_at_idx(&cvm->list, i));
-        if (cvm->marked[idx] == 0) {
-            ivec_erase_at_idx(&cvm->list, i);
-        } else {
-            i++;
+    int size = 0;
+    for (int i = 0; i < cvm->list.size; i++) {
+        Color c = cvm->list.store[i];
+        if (cvm->marked[color_to_idx(c)] != 0) {
+            cvm->list.store[size++] = c;
         }
     }
+    cvm->list.size = size;
     return &cvm->list;
 }
 
@@ -289,7 +350,7 @@ inline int cvmap_insert_one(ColorVecMap *cvm, const Color c, int value)
 
 inline int cvmap_copy(const ColorVecMap *src, ColorVecMap *dst)
 {
-    memcpy(dst->marked, src->marked, (2 * N * NN + 1) * sizeof(int));
+    memcpy(dst->marked, src->marked, (2 * N * NN + 1) * sizeof(uint8_t));
     GUARD(ivec_copy(&src->list, &dst->list));
     for (int i = 0; i < 2 * N * NN + 1; i++) {
         GUARD(ivec_copy(&src->store[i], &dst->store[i]));
@@ -297,4 +358,13 @@ inline int cvmap_copy(const ColorVecMap *src, ColorVecMap *dst)
     return 0;
 }
 
+inline long cvmap_mem_bytes(const ColorVecMap *cvm)
+{
+    long bytes = ivec_mem_bytes(&cvm->list);
+    for (int i = 0; i < 2 * N * NN + 1; i++) {
+        bytes += ivec_mem_bytes(&cvm->store[i]);
+    }
+    return bytes;
+}
+
 #endif // CUSTOMTYPES_H
@@ -0,0 +1,233 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "dlx.h"
+
+#include <string.h>
+
+#include "timing.h"
+
+// cell 0 is the root, cells 1 to kDlxColumnCount the column headers of the rules
+enum {
+    kRoot = 0,
+    kFirstRowCell = 1 + kDlxColumnCount,
+    kDeadlineBranches = 1024 // branches between two reads of the clock
+};
+
+int dlx_init(Dlx *dlx, const Grid *base_grid)
+{
+    for (int c = 0; c <= kDlxColumnCount; c++) {
+        dlx->left[c] = (c == 0 ? kDlxColumnCount : c - 1);
+        dlx->right[c] = (c == kDlxColumnCount ? 0 : c + 1);
+        dlx->up[c] = dlx->down[c] = c;
+        dlx->column[c] = c;
+        dlx->node[c] = NA;
+        dlx->column_size[c] = 0;
+    }
+
+    // a node has its kUnitCount cells in a row, in the order of the rules
+    int cell_cnt[N * NN];
+    memset(cell_cnt, 0x00, sizeof(cell_cnt));
+    for (int idx = 0; idx < kDlxColumnCount; idx++) {
+        const IntVec *rule = &base_grid->color_exclusions[idx];
+        if (ivec_size(rule) != N) {
+            return NA;
+        }
+        const int c = 1 + idx;
+        for (int i = 0; i < N; i++) {
+            Color color = ivec_at_idx(rule, i);
+            if (color <= 0 || color > N * NN || cell_cnt[color - 1] == kUnitCount) {
+                return NA;
+            }
+            const NodeId node_id = color - 1;
+            const int cell = kFirstRowCell + node_id * kUnitCount + cell_cnt[node_id]++;
+            dlx->column[cell] = c;
+            dlx->node[cell] = node_id;
+            dlx->up[cell] = dlx->up[c];
+            dlx->down[cell] = c;
+            dlx->down[dlx->up[c]] = cell;
+            dlx->up[c] = cell;
+            dlx->column_size[c]++;
+        }
+    }
+    for (NodeId node_id = 0; node_id < N * NN; node_id++) {
+        if (cell_cnt[node_id] != kUnitCount) {
+            return NA;
+        }
+        const int first = kFirstRowCell + node_id * kUnitCount;
+        for (int i = 0; i < kUnitCount; i++) {
+            dlx->left[first + i] = first + (i + kUnitCount - 1) % kUnitCount;
+            dlx->right[first + i] = first + (i + 1) % kUnitCount;
+        }
+        dlx->row_first[node_id] = first;
+    }
+
+    dlx->selected_size = 0;
+    dlx->clue_cnt = 0;
+    dlx->solution_size = 0;
+    memset(dlx->solution, 0xFF, NN * sizeof(NodeId));
+    dlx->branch_limit = 0;
+    dlx->deadline_ns = 0;
+    dlx->branch_cnt = 0;
+    dlx->limit_reached = 0;
+    return 0;
+}
+
+static void dlx_cover(Dlx *dlx, int c)
+{
+    dlx->right[dlx->left[c]] = dlx->right[c];
+    dlx->left[dlx->right[c]] = dlx->left[c];
+    for (int i = dlx->down[c]; i != c; i = dlx->down[i]) {
+        for (int j = dlx->right[i]; j != i; j = dlx->right[j]) {
+            dlx->down[dlx->up[j]] = dlx->down[j];
+            dlx->up[dlx->down[j]] = dlx->up[j];
+            dlx->column_size[dlx->column[j]]--;
+        }
+    }
+}
+
+static void dlx_uncover(Dlx *dlx, int c)
+{
+    for (int i = dlx->up[c]; i != c; i = dlx->up[i]) {
+        for (int j = dlx->left[i]; j != i; j = dlx->left[j]) {
+            dlx->column_size[dlx->column[j]]++;
+            dlx->down[dlx->up[j]] = j;
+            dlx->up[dlx->down[j]] = j;
+        }
+    }
+    dlx->right[dlx->left[c]] = c;
+    dlx->left[dlx->right[c]] = c;
+}
+
+static void dlx_select(Dlx *dlx, int cell)
+{
+    dlx_cover(dlx, dlx->column[cell]);
+    for (int j = dlx->right[cell]; j != cell; j = dlx->right[j]) {
+        dlx_cover(dlx, dlx->column[j]);
+    }
+    dlx->selected[dlx->selected_size++] = cell;
+}
+
+static void dlx_unselect(Dlx *dlx)
+{
+    const int cell = dlx->selected[--dlx->selected_size];
+    for (int j = dlx->left[cell]; j != cell; j = dlx->left[j]) {
+        dlx_uncover(dlx, dlx->column[j]);
+    }
+    dlx_uncover(dlx, dlx->column[cell]);
+}
+
+int dlx_populate(Dlx *dlx, const char *grid_str)
+{
+    PRINT_INFO("%s\n", __func__);
+
+    // back to the empty matrix
+    while (dlx->selected_size != 0) {
+        dlx_unselect(dlx);
+    }
+    dlx->clue_cnt = 0;
+    dlx->solution_size = 0;
+    memset(dlx->solution, 0xFF, NN * sizeof(NodeId));
+
+    GUARD(grid_check_str(grid_str));
+    for (int i = 0; i < NN; i++) {
+        int n = grid_char_to_int(grid_str[i]);
+        if (n == NA) {
+            continue;
+        }
+        const int cell = dlx->row_first[i * N + n];
+        // a rule already covered means 2 clues in conflict
+        int j = cell;
+        do {
+            int c = dlx->column[j];
+            if (dlx->right[dlx->left[c]] != c) {
+                PRINT_INFO("%s invalid grid, clue %d in conflict\n", __func__, i);
+                return NA;
+            }
+            j = dlx->right[j];
+        } while (j != cell);
+        dlx_select(dlx, cell);
+        dlx->solution[i] = i * N + n;
+        dlx->clue_cnt++;
+    }
+    dlx->solution_size = dlx->clue_cnt;
+
+    PRINT_INFO("%s clues count %d\n", __func__, dlx->clue_cnt);
+
+    return 0;
+}
+
+// algorithm X, column with the fewest rows first
+static void dlx_search(Dlx *dlx, int limit, int *count)
+{
+    if (dlx->right[kRoot] == kRoot) {
+        if ((*count)++ == 0) {
+            for (int i = dlx->clue_cnt; i < dlx->selected_size; i++) {
+                NodeId node_id = dlx->node[dlx->selected[i]];
+                dlx->solution[node_id / N] = node_id;
+            }
+            dlx->solution_size = NN;
+        }
+        return;
+    }
+    int c = dlx->right[kRoot];
+    for (int j = dlx->right[c]; j != kRoot; j = dlx->right[j]) {
+        if (dlx->column_size[j] < dlx->column_size[c]) {
+            c = j;
+        }
+    }
+    for (int i = dlx->down[c]; i != c && *count < limit; i = dlx->down[i]) {
+        if ((dlx->branch_limit != 0 && dlx->branch_cnt >= dlx->branch_limit)
+                || (dlx->deadline_ns != 0 && dlx->branch_cnt % kDeadlineBranches == 0
+                    && dlx->branch_cnt != 0 && timing_now_ns() >= dlx->deadline_ns)) {
+            dlx->limit_reached = 1;
+            return;
+        }
+        dlx->branch_cnt++;
+        dlx_select(dlx, i);
+        dlx_search(dlx, limit, count);
+        dlx_unselect(dlx);
+    }
+}
+
+int dlx_count_solutions(Dlx *dlx, int limit)
+{
+    int count = 0;
+    dlx->branch_cnt = 0;
+    dlx->limit_reached = 0;
+    dlx_search(dlx, limit, &count);
+    return count;
+}
+
+int dlx_solve(Dlx *dlx)
+{
+    dlx_count_solutions(dlx, 1);
+    return dlx->solution_size;
+}
+
+void dlx_get_grid_str(const Dlx *dlx, char str[NN + 1])
+{
+    for (int i = 0; i < NN; i++) {
+        int u = dlx->solution[i];
+        str[i] = (u == NA ? '.' : int_to_grid_char(u % N));
+    }
+    str[NN] = '\0';
+}
@@ -0,0 +1,76 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DLX_H
+#define DLX_H
+
+#include "consts.h"
+#include "grid.h"
+
+/*
+ * Summary:
+ *
+ * Dancing Links (Knuth's algorithm X) engine, an alternative to the color solver.
+ * The rules of a Grid from grid_init_data are an exact cover matrix : one column by rule,
+ * one row by node, a node is in kUnitCount rules and one and only one node is true by rule.
+ * Same usage as a Grid : populate, solve, get the grid string.
+ */
+
+enum {
+    kDlxColumnCount = kUnitCount * NN,
+    // root, then the column headers, then kUnitCount cells by node
+    kDlxSize = 1 + kDlxColumnCount + kUnitCount * N * NN
+};
+
+typedef struct
+{
+    int left[kDlxSize], right[kDlxSize], up[kDlxSize], down[kDlxSize];
+    int column[kDlxSize]; // column header of a cell
+    NodeId node[kDlxSize]; // node of the row of a cell
+    int column_size[kDlxSize]; // number of rows in a column, for the headers
+    int row_first[N * NN]; // first cell of the row of a node
+    int selected[NN]; // cells of the rows selected, clues first
+    int selected_size;
+    int clue_cnt;
+    NodeId solution[NN]; // node by grid position, NA if unknown
+    int solution_size;
+    long branch_limit; // max number of branches by search, 0 for no limit
+    int64_t deadline_ns; // monotonic time (timing.h) the search stops at, 0 for none, read every 1024 branches
+    long branch_cnt; // number of branches of the last search
+    int limit_reached; // set if the last search stopped at branch_limit or at deadline_ns
+} Dlx;
+
+// build the matrix from the rules of a grid just initialized by grid_init_data, no branch limit nor deadline
+// return NA if the rules are not the ones of an empty grid
+int  dlx_init(Dlx *dlx, const Grid *base_grid);
+// populate from a grid string, same conventions as grid_populate
+// return NA if string is not of the expected length, for a 9x9 sudoku if the number of clues is < 17
+// and if two clues are in conflict
+int  dlx_populate(Dlx *dlx, const char *grid_str);
+// search the first solution
+// return the number of nodes known, NN if a solution was found, the clue count if there is none
+int  dlx_solve(Dlx *dlx);
+// count the solutions, stop at limit, the first one is kept as solution
+// return the number of solutions in [0, limit]
+// if branch_limit or deadline_ns is reached the count is a lower bound, limit_reached is set
+int  dlx_count_solutions(Dlx *dlx, int limit);
+// put the solution in str, use '.' for the positions not solved
+void dlx_get_grid_str(const Dlx *dlx, char str[NN + 1]);
+
+#endif // DLX_H
@@ -0,0 +1,213 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "edit.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// push the state of the grid with the clues so far
+// return NA if alloc fails
+static int gedit_push(GridEdit *ge)
+{
+    EditSnapshot *snapshot = &ge->snapshots[ge->snapshot_cnt];
+    long size = grid_save(&ge->grid, snapshot->blob, snapshot->capacity);
+    if (size > snapshot->capacity) {
+        uint8_t *blob = realloc(snapshot->blob, size);
+        if (!blob) {
+            return NA;
+        }
+        snapshot->blob = blob;
+        snapshot->capacity = size;
+        grid_save(&ge->grid, snapshot->blob, snapshot->capacity);
+    }
+    snapshot->size = size;
+    snapshot->clue_cnt = ge->clue_cnt;
+    ge->snapshot_cnt++;
+    return 0;
+}
+
+// restore a snapshot, the ones above it are dropped
+// return NA if alloc fails
+static int gedit_restore(GridEdit *ge, int idx)
+{
+    ge->snapshot_cnt = idx + 1;
+    ge->invalid = 0;
+    GUARD(grid_load(&ge->grid, ge->snapshots[idx].blob, ge->snapshots[idx].size));
+    // the stages of the snapshot may not be the ones set since
+    grid_set_stages(&ge->grid, ge->stage_mask, ge->adaptive);
+    return 0;
+}
+
+// the candidates left are checked as the search does, grid_solve does not
+static int gedit_check(GridEdit *ge)
+{
+    for (int i = 0; i < ge->clue_cnt; i++) {
+        if (ge->grid.validated_nodes[ge->clues[i] / N] != ge->clues[i]) {
+            return NA;
+        }
+    }
+    grid_get_cands_str(&ge->grid, ge->cands_str);
+    if (bgrid_populate_cands(&ge->bit_grid, ge->cands_str) == NA || bgrid_solve_singles(&ge->bit_grid) == NA) {
+        return NA;
+    }
+    return 0;
+}
+
+// add the clues from index from to the grid solved with the ones before, solve and push the new state
+// return NA if alloc fails, else the number of nodes validated, 0 if invalid
+static int gedit_solve(GridEdit *ge, int from)
+{
+    if (from == ge->clue_cnt) {
+        return ge->grid.validated_size;
+    }
+    // a clue that is not a candidate anymore is in conflict, grid_assume_node can not tell it from an alloc failure
+    grid_get_cands_str(&ge->grid, ge->cands_str);
+    for (int i = from; i < ge->clue_cnt; i++) {
+        if (ge->cands_str[ge->clues[i]] == '.') {
+            ge->invalid = 1;
+            return 0;
+        }
+        GUARD(grid_assume_node(&ge->grid, ge->clues[i]));
+    }
+    int ret = grid_solve(&ge->grid);
+#ifdef CHECK_GRID
+    // NA is also the invalid grid flag
+    if (ret == NA) {
+        ge->invalid = 1;
+        return 0;
+    }
+#else
+    GUARD(ret);
+#endif
+    if (ge->grid.invalid || gedit_check(ge) == NA) {
+        ge->invalid = 1;
+        return 0;
+    }
+    GUARD(gedit_push(ge));
+    return ret;
+}
+
+// NOTE: if fails no need to call gedit_free
+int gedit_init(GridEdit *ge)
+{
+    ge->clue_cnt = 0;
+    ge->snapshot_cnt = 0;
+    ge->invalid = 0;
+    ge->stage_mask = kStageAll;
+    ge->adaptive = 0;
+    memset(ge->snapshots, 0x00, sizeof(ge->snapshots));
+    if (grid_init(&ge->base_grid) == NA) {
+        return NA;
+    }
+    if (grid_init(&ge->grid) == NA) {
+        grid_free(&ge->base_grid);
+        return NA;
+    }
+    // no clue : nothing to solve, the state of the empty grid is the first snapshot
+    if (grid_init_data(&ge->base_grid) == NA || grid_copy(&ge->base_grid, &ge->grid) == NA || gedit_push(ge) == NA) {
+        gedit_free(ge);
+        return NA;
+    }
+    return 0;
+}
+
+void gedit_free(GridEdit *ge)
+{
+    for (int i = 0; i < NN + 1; i++) {
+        free(ge->snapshots[i].blob);
+        ge->snapshots[i].blob = NULL;
+        ge->snapshots[i].capacity = 0;
+    }
+    grid_free(&ge->grid);
+    grid_free(&ge->base_grid);
+}
+
+void gedit_set_stages(GridEdit *ge, unsigned stage_mask, int adaptive)
+{
+    ge->stage_mask = stage_mask;
+    ge->adaptive = adaptive;
+    grid_set_stages(&ge->grid, stage_mask, adaptive);
+}
+
+int gedit_set(GridEdit *ge, const char *grid_str)
+{
+    if (strlen(grid_str) != NN) {
+        return NA;
+    }
+    GUARD(gedit_restore(ge, 0));
+    ge->clue_cnt = 0;
+    for (int i = 0; i < NN; i++) {
+        int n = grid_char_to_int(grid_str[i]);
+        if (n != NA) {
+            ge->clues[ge->clue_cnt++] = i * N + n;
+        }
+    }
+    return gedit_solve(ge, 0);
+}
+
+int gedit_add_clue(GridEdit *ge, int cell, int n)
+{
+    if (cell < 0 || cell >= NN || n < 0 || n >= N) {
+        return NA;
+    }
+    for (int i = 0; i < ge->clue_cnt; i++) {
+        if (ge->clues[i] / N == cell) {
+            return NA;
+        }
+    }
+    ge->clues[ge->clue_cnt++] = cell * N + n;
+    if (ge->invalid) {
+        return 0;
+    }
+    return gedit_solve(ge, ge->clue_cnt - 1);
+}
+
+int gedit_remove_clue(GridEdit *ge, int cell)
+{
+    int k = 0;
+    while (k < ge->clue_cnt && ge->clues[k] / N != cell) {
+        k++;
+    }
+    if (k == ge->clue_cnt) {
+        return NA;
+    }
+    memmove(ge->clues + k, ge->clues + k + 1, (ge->clue_cnt - k - 1) * sizeof(NodeId));
+    ge->clue_cnt--;
+    // the last state without the clue, snapshots[0] has none
+    int idx = ge->snapshot_cnt - 1;
+    while (ge->snapshots[idx].clue_cnt > k) {
+        idx--;
+    }
+    GUARD(gedit_restore(ge, idx));
+    return gedit_solve(ge, ge->snapshots[idx].clue_cnt);
+}
+
+void gedit_get_grid_str(GridEdit *ge, char str[NN + 1])
+{
+    if (!ge->invalid) {
+        grid_get_grid_str(&ge->grid, str);
+        return;
+    }
+    memset(str, '.', NN);
+    str[NN] = '\0';
+    for (int i = 0; i < ge->clue_cnt; i++) {
+        str[ge->clues[i] / N] = int_to_grid_char(ge->clues[i] % N);
+    }
+}
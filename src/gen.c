@@ -0,0 +1,375 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Corpus generator, a separate program from the solver.
+ *
+ * Compilation :
+ *
+ *  cc -std=c99 -DNDEBUG -Wall -Wextra -Werror -O2 -I. gen.c solver.c grid.c bitgrid.c bitbatch.c search.c dlx.c perf.c customtypes.c canon.c cache.c -o ./rSudokuGen
+ *  add -DD=4 or -DD=5 for 16x16 or 25x25 grids
+ *
+ * Usage :
+ *
+ * ./rSudokuGen --count 100 --band hard --seed 7 > hard.txt # new grids
+ * ./rSudokuGen --count 1000 --from ../grids/veryHardGrids.txt > veryHardX.txt # transforms of a corpus
+ *
+ * The output is a grid by line, the format of the corpora of ../grids, so it is read as is by
+ * rSudokuSolver and rSudokuBench. The same seed, count, options and D give the same corpus.
+ *
+ * New grids : the diagonal boxes are filled at random and completed, then the clues are removed in a random
+ * order as long as the solution stays unique, until --max-empty cells are empty or no clue can be removed.
+ * The solutions are counted by a second solver in count mode : the singles fast path, then dlx on the
+ * residual only, much smaller than the whole grid, within kCountBranches branches : at 25x25 a count
+ * can otherwise run for minutes.
+ * Transforms : each grid is a grid of the --from corpus picked at random, with its symbols relabeled,
+ * its bands, stacks, rows in a band and columns in a stack permuted, transposed or not.
+ * In both modes, the uniqueness is checked again and the grid is kept only if the solver
+ * solves it, within --max-branches search branches if set, and finds it in the difficulty band : its class,
+ * see solver.h.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "solver.h"
+
+enum {
+    kAnyBand = NA,
+    kDefaultTries = 1000, // by grid
+    // dlx branches by count, a uniqueness not proven within them is a failure : the clue stays
+    kCountBranches = 20000
+};
+
+typedef struct
+{
+    char (*grids)[NN + 1];
+    int size, capacity;
+} Corpus;
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage : %s [options]\n"
+            " --count n           grids to generate, default 100\n"
+            " --seed n            seed of the generator, default 1\n"
+            " --band b            class of the grids : singles, medium or hard, default any\n"
+            " --from file         transforms of the grids of a corpus instead of new grids\n"
+            " --max-empty n       new grids, stop removing clues at n empty cells, default all the cells\n"
+            " --max-branches n    skip the grids the search needs more branches for, default 0 for no limit\n"
+            " --tries n           attempts by grid before giving up, default %d\n"
+            " --out file          write the grids there instead of stdout\n",
+            name, kDefaultTries);
+}
+
+// xorshift64*, enough for shuffles and reproducible on every platform
+static uint64_t rng_next(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// return a value in [0, n)
+static int rng_below(uint64_t *state, int n)
+{
+    return (int)(rng_next(state) % (uint64_t)n);
+}
+
+static void shuffle(uint64_t *state, int *values, int size)
+{
+    for (int i = size - 1; i > 0; i--) {
+        int j = rng_below(state, i + 1);
+        int tmp = values[i];
+        values[i] = values[j];
+        values[j] = tmp;
+    }
+}
+
+// a random permutation of [0, size)
+static void random_perm(uint64_t *state, int *perm, int size)
+{
+    for (int i = 0; i < size; i++) {
+        perm[i] = i;
+    }
+    shuffle(state, perm, size);
+}
+
+// same reading as rSudokuSolver, the malformed grids are skipped
+// return NA if the file can not be read or if alloc fails
+static int corpus_load(Corpus *corpus, const char *path)
+{
+    corpus->grids = NULL;
+    corpus->size = corpus->capacity = 0;
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return NA;
+    }
+    char scan_fmt[16];
+    snprintf(scan_fmt, sizeof(scan_fmt), " %%%ds", NN * N);
+    static char grid_str[NN * N + 1];
+    int result = 0;
+    while (fscanf(f, scan_fmt, grid_str) == 1) {
+        if (grid_check_str(grid_str) == NA) {
+            continue;
+        }
+        if (corpus->size == corpus->capacity) {
+            int capacity = corpus->capacity ? 2 * corpus->capacity : 256;
+            void *grids = realloc(corpus->grids, capacity * sizeof(*corpus->grids));
+            if (!grids) {
+                result = NA;
+                break;
+            }
+            corpus->grids = grids;
+            corpus->capacity = capacity;
+        }
+        memcpy(corpus->grids[corpus->size++], grid_str, NN + 1);
+    }
+    fclose(f);
+    return result;
+}
+
+// a random transform of the sudoku symmetry group, the solution count and the class are kept
+static void transform(uint64_t *state, const char *src, char dst[NN + 1])
+{
+    int bands[D], stacks[D], rows[N], cols[N], symbols[N];
+    random_perm(state, bands, D);
+    random_perm(state, stacks, D);
+    random_perm(state, symbols, N);
+    // row r of dst is row rows[r] of src, the rows stay in their band
+    for (int b = 0; b < D; b++) {
+        int in_band[D], in_stack[D];
+        random_perm(state, in_band, D);
+        random_perm(state, in_stack, D);
+        for (int i = 0; i < D; i++) {
+            rows[b * D + i] = bands[b] * D + in_band[i];
+            cols[b * D + i] = stacks[b] * D + in_stack[i];
+        }
+    }
+    const int transposed = rng_below(state, 2);
+    for (int r = 0; r < N; r++) {
+        for (int c = 0; c < N; c++) {
+            int i = (transposed ? cols[c] * N + rows[r] : rows[r] * N + cols[c]);
+            int n = grid_char_to_int(src[i]);
+            dst[r * N + c] = (n == NA ? '.' : int_to_grid_char(symbols[n]));
+        }
+    }
+    dst[NN] = '\0';
+}
+
+// a random solution : the diagonal boxes do not share a unit, any filling of them can be completed
+// return 1 if found, 0 if not, NA if alloc fails
+static int random_solution(uint64_t *state, Solver *counter, char out[NN + 1])
+{
+    static char grid_str[NN + 1], solution[NN + 1];
+    memset(grid_str, '.', NN);
+    grid_str[NN] = '\0';
+    for (int b = 0; b < D; b++) {
+        int symbols[N];
+        random_perm(state, symbols, N);
+        for (int i = 0; i < N; i++) {
+            grid_str[(b * D + i / D) * N + b * D + i % D] = int_to_grid_char(symbols[i]);
+        }
+    }
+    SolveResult result;
+    GUARD(solver_solve(counter, grid_str, solution, &result));
+    if (result.solution_cnt == 0) {
+        return 0;
+    }
+    // the first solution counted is always the same for these clues, the transform spreads them
+    transform(state, solution, out);
+    return 1;
+}
+
+// return 1 if the grid has one solution only, the counter is a solver in count mode
+// return NA if alloc fails
+static int is_unique(Solver *counter, const char *grid_str)
+{
+    static char out[NN + 1];
+    SolveResult result;
+    GUARD(solver_solve(counter, grid_str, out, &result));
+    return result.status == kSolveSolved && result.solution_cnt == 1 && !result.lower_bound;
+}
+
+// remove the clues in a random order while the solution stays unique
+// return NA if alloc fails
+static int remove_clues(uint64_t *state, Solver *counter, char grid_str[NN + 1], int max_empty)
+{
+    int cells[NN];
+    random_perm(state, cells, NN);
+    int empty = 0;
+    for (int i = 0; i < NN && empty < max_empty; i++) {
+        const char clue = grid_str[cells[i]];
+        grid_str[cells[i]] = '.';
+        int ret = is_unique(counter, grid_str);
+        GUARD(ret);
+        if (ret) {
+            empty++;
+        } else {
+            grid_str[cells[i]] = clue;
+        }
+    }
+    return 0;
+}
+
+// return 1 if the grid is kept : unique, solved by the solver and in the band
+// return NA if alloc fails
+static int accept(Solver *solver, Solver *counter, const char *grid_str, int band)
+{
+    static char out[NN + 1];
+    SolveResult result;
+    int ret = is_unique(counter, grid_str);
+    if (ret != 1) {
+        return ret;
+    }
+    GUARD(solver_solve(solver, grid_str, out, &result));
+    return result.status == kSolveSolved && (band == kAnyBand || result.difficulty == band);
+}
+
+int main(int argc, char *argv[])
+{
+    int count = 100, band = kAnyBand, max_empty = NN, tries = kDefaultTries;
+    long max_branches = 0;
+    uint64_t seed = 1;
+    const char *from = NULL, *out_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--band") == 0 && i + 1 < argc) {
+            band = solver_class_from_name(argv[++i]);
+            if (band == NA || band == kClassInvalid) {
+                fprintf(stderr, "unknown band %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+            from = argv[++i];
+        } else if (strcmp(argv[i], "--max-empty") == 0 && i + 1 < argc) {
+            max_empty = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-branches") == 0 && i + 1 < argc) {
+            max_branches = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--tries") == 0 && i + 1 < argc) {
+            tries = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (count < 0 || max_empty < 1 || max_branches < 0 || tries < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    // xorshift needs a state not 0, the same seed gives the same corpus
+    uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    Corpus corpus = { NULL, 0, 0 };
+    if (from) {
+        if (corpus_load(&corpus, from) == NA) {
+            return EXIT_FAILURE;
+        }
+        if (corpus.size == 0) {
+            fprintf(stderr, "%s : no grid\n", from);
+            free(corpus.grids);
+            return EXIT_FAILURE;
+        }
+    }
+    FILE *out = stdout;
+    if (out_path && !(out = fopen(out_path, "w"))) {
+        perror(out_path);
+        free(corpus.grids);
+        return EXIT_FAILURE;
+    }
+
+    // the solvers are large, keep them off the stack
+    static Solver solver, counter;
+    static char grid_str[NN + 1];
+    SolverOpts opts, counter_opts;
+    solver_default_opts(&opts);
+    // the search stops there, the grid is then not solved
+    opts.search_limit = max_branches;
+    // count on the residual of the singles with dlx, no estimate needed
+    solver_default_opts(&counter_opts);
+    counter_opts.count_mode = 1;
+    counter_opts.search_limit = kCountBranches;
+    counter_opts.routes[kClassMedium] = counter_opts.routes[kClassHard] = kEngineDlx;
+    if (solver_init(&solver, &opts) == NA) {
+        fprintf(stderr, "init failed\n");
+        if (out != stdout) {
+            fclose(out);
+        }
+        free(corpus.grids);
+        return EXIT_FAILURE;
+    }
+    int result = EXIT_SUCCESS;
+    const int counter_ready = (solver_init(&counter, &counter_opts) != NA);
+    if (!counter_ready) {
+        fprintf(stderr, "init failed\n");
+        result = EXIT_FAILURE;
+        count = 0;
+    }
+
+    int generated = 0;
+    long attempts = 0;
+    for (; generated < count; generated++) {
+        int ret = 0;
+        for (int t = 0; t < tries && ret == 0; t++, attempts++) {
+            if (from) {
+                transform(&state, corpus.grids[rng_below(&state, corpus.size)], grid_str);
+            } else {
+                ret = random_solution(&state, &counter, grid_str);
+                if (ret != 1) {
+                    // 0 : try again, NA : stop
+                    continue;
+                }
+                if (remove_clues(&state, &counter, grid_str, max_empty) == NA) {
+                    ret = NA;
+                    continue;
+                }
+            }
+            ret = accept(&solver, &counter, grid_str, band);
+        }
+        if (ret != 1) {
+            fprintf(stderr, ret == NA ? "alloc failed\n" : "no grid in the band after %d tries\n", tries);
+            result = EXIT_FAILURE;
+            break;
+        }
+        fprintf(out, "%s\n", grid_str);
+    }
+    fprintf(stderr, "%d grids of %dx%d, %ld attempts, seed %llu\n",
+            generated, N, N, attempts, (unsigned long long)seed);
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    free(corpus.grids);
+    solver_free(&solver);
+    if (counter_ready) {
+        solver_free(&counter);
+    }
+
+    return result;
+}
@@ -17,9 +17,14 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+// clock_gettime
+#define _POSIX_C_SOURCE 200809L
+
 #include "grid.h"
+#include "timing.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -58,27 +63,8 @@ int  grid_merge_check_SCC(Grid *grid);
 int  grid_validate_check_cycle(Grid *grid);
 int  grid_validate_check_cycle_level_2(Grid *grid);
 
-static inline int grid_char_to_int(const char c)
-{
-    if (D == 3) {
-        return c >= '1' && c <= '9' ? c - '1' : NA ;
-    } else if (D == 4) {
-        return (c >= '0' && c <= '9') ? c - '0' :
-               ((c >= 'A' && c <= 'F') ? c - 'A' + 10 :
-               ((c >= 'a' && c <= 'f') ? c - 'a' + 10 : NA));
-    }
-    return NA;
-}
-
-static inline char int_to_grid_char(const int n)
-{
-    if (D == 3) {
-        return n + '1';
-    } else if (D == 4) {
-        return n < 10 ? '0' + n : 'A' - 10 + n;
-    }
-    return NA;
-}
+extern inline int  grid_char_to_int(const char c);
+extern inline char int_to_grid_char(const int n);
 
 static inline Color rev_color(Color color)
 {
@@ -100,10 +86,16 @@ int grid_init(Grid *grid)
 #endif
     memset(grid->validated_nodes, 0xFF, NN * sizeof(NodeId));
     grid->validated_size = 0;
+    grid->invalid = 0;
     cvmap_init(&grid->color_to_nodes);
     cvmap_init(&grid->color_to_exclusion_idx);
     cvmap_init(&grid->true_to_false_colors);
-    grid->color_exclusions = malloc(NN * 4 * sizeof(ColorVecMap));
+    ivec_init(&grid->excl_color_cnt_base);
+    ivec_init(&grid->excl_color_cnt);
+    ivec_init(&grid->excl_color_cnt_bak);
+    ivec_init(&grid->scc_stack_color);
+    ivec_init(&grid->scc_stack_polarity);
+    grid->color_exclusions = malloc(NN * 4 * sizeof(IntVec));
     if (!grid->color_exclusions) {
         return NA;
     }
@@ -112,6 +104,18 @@ int grid_init(Grid *grid)
     }
     ivec_init(&grid->to_validate);
     ivec_init(&grid->to_merge);
+    grid->true_to_false_stale = 1;
+    grid->stage_mask = kStageAll;
+    grid->adaptive = 0;
+    memset(grid->stage_stats, 0x00, sizeof(grid->stage_stats));
+    grid->validated_cnt = grid->merged_cnt = grid->eliminated_cnt = grid->vertex_cnt = 0;
+    grid->perf = NULL;
+    grid->limits = NULL;
+    grid->limit_vertex_cnt = 0;
+    grid->stalled_stages = 0;
+    grid->cycle_cursor = 0;
+    grid->level2_cursor[0] = grid->level2_cursor[1] = 0;
+    grid->step = NULL;
     return 0;
 }
 
@@ -124,6 +128,7 @@ int grid_copy(const Grid *src, Grid *dst)
 #endif
     memcpy(dst->validated_nodes, src->validated_nodes, NN * sizeof(NodeId));
     dst->validated_size = src->validated_size;
+    dst->invalid = src->invalid;
     GUARD(cvmap_copy(&src->color_to_nodes, &dst->color_to_nodes));
     GUARD(cvmap_copy(&src->color_to_exclusion_idx, &dst->color_to_exclusion_idx));
     GUARD(cvmap_copy(&src->true_to_false_colors, &dst->true_to_false_colors));
@@ -135,10 +140,45 @@ int grid_copy(const Grid *src, Grid *dst)
     }
     GUARD(ivec_copy(&src->to_validate, &dst->to_validate));
     GUARD(ivec_copy(&src->to_merge, &dst->to_merge));
+    dst->true_to_false_stale = src->true_to_false_stale;
+    dst->stage_mask = src->stage_mask;
+    dst->adaptive = src->adaptive;
+    memcpy(dst->stage_stats, src->stage_stats, sizeof(src->stage_stats));
+    dst->validated_cnt = src->validated_cnt;
+    dst->merged_cnt = src->merged_cnt;
+    dst->eliminated_cnt = src->eliminated_cnt;
+    dst->vertex_cnt = src->vertex_cnt;
+    dst->perf = src->perf;
+    dst->limits = src->limits;
+    dst->limit_vertex_cnt = src->limit_vertex_cnt;
+    dst->stalled_stages = src->stalled_stages;
+    dst->cycle_cursor = src->cycle_cursor;
+    dst->level2_cursor[0] = src->level2_cursor[0];
+    dst->level2_cursor[1] = src->level2_cursor[1];
 
     return 0;
 }
 
+long grid_mem_bytes(const Grid *grid)
+{
+    long bytes = sizeof(Grid);
+    bytes += cvmap_mem_bytes(&grid->color_to_nodes);
+    bytes += cvmap_mem_bytes(&grid->color_to_exclusion_idx);
+    bytes += cvmap_mem_bytes(&grid->true_to_false_colors);
+    if (grid->color_exclusions) {
+        bytes += NN * 4 * sizeof(IntVec);
+        for (int i = 0; i < NN * 4; i++) {
+            bytes += ivec_mem_bytes(&grid->color_exclusions[i]);
+        }
+    }
+    bytes += ivec_mem_bytes(&grid->to_validate);
+    bytes += ivec_mem_bytes(&grid->to_merge);
+    bytes += ivec_mem_bytes(&grid->excl_color_cnt_base) + ivec_mem_bytes(&grid->excl_color_cnt);
+    bytes += ivec_mem_bytes(&grid->excl_color_cnt_bak);
+    bytes += ivec_mem_bytes(&grid->scc_stack_color) + ivec_mem_bytes(&grid->scc_stack_polarity);
+    return bytes;
+}
+
 void grid_free(Grid *grid)
 {
     cvmap_free(&grid->color_to_nodes);
@@ -152,6 +192,11 @@ void grid_free(Grid *grid)
     }
     ivec_free(&grid->to_validate);
     ivec_free(&grid->to_merge);
+    ivec_free(&grid->excl_color_cnt_base);
+    ivec_free(&grid->excl_color_cnt);
+    ivec_free(&grid->excl_color_cnt_bak);
+    ivec_free(&grid->scc_stack_color);
+    ivec_free(&grid->scc_stack_polarity);
 }
 
 int grid_init_data(Grid *grid)
@@ -206,8 +251,15 @@ int grid_init_data(Grid *grid)
 
 int grid_validate_node(Grid *grid, NodeId node_id)
 {
+    if (grid->validated_nodes[node_id / N] != NA && grid->validated_nodes[node_id / N] != node_id) {
+        PRINT_INFO("%s invalid grid, 2 symbols for cell %d\n", __func__, node_id / N);
+        grid->invalid = 1;
+    }
     grid->validated_size++;
     grid->validated_nodes[node_id / N] = node_id;
+    if (grid->step) {
+        GUARD(ivec_push_back(&grid->step->validated, node_id));
+    }
 
 #ifdef CHECK_GRID
     int cand = node_id % N, row_col = node_id / N;
@@ -223,6 +275,7 @@ int grid_validate_node(Grid *grid, NodeId node_id)
             grid->constraint_cnt_check[i][constraints[i]] = NN;
         } else {
             PRINT_INFO("%s invalid grid\n", __func__);
+            grid->invalid = 1;
             return NA;
         }
     }
@@ -245,6 +298,7 @@ int grid_remove_node(Grid *grid, NodeId node_id)
             grid->constraint_cnt_check[i][constraints[i]]++;
             if (grid->constraint_cnt_check[i][constraints[i]] == N) {
                 PRINT_INFO("%s invalid grid\n", __func__);
+                grid->invalid = 1;
                 return NA;
             }
         }
@@ -259,6 +313,7 @@ int grid_validate_enqueue(Grid *grid, Color color)
 #ifdef CHECK_GRID
     if (ivec_find_first_from(&grid->to_validate, 0, rev_color(color)) != NA) {
         PRINT_INFO("%s invalid grid, reverse color and color %+4d are true\n", __func__, color);
+        grid->invalid = 1;
         return NA;
     }
 #endif
@@ -269,58 +324,112 @@ int grid_validate_enqueue(Grid *grid, Color color)
     return 0;
 }
 
-int grid_populate(Grid *grid, const char *grid_str)
+int grid_check_str(const char *grid_str)
 {
-    PRINT_INFO("%s\n", __func__);
-
     if (strlen(grid_str) != NN) {
         PRINT_INFO("%s invalid size %ld\n", __func__, strlen(grid_str));
         return NA;
     }
     int clues = 0;
+    for (int i = 0; i < NN; i++) {
+        clues += (grid_char_to_int(grid_str[i]) != NA);
+    }
+    if (D == 3 && clues < 17) {
+        PRINT_INFO("%s not enough clues\n", __func__);
+        return NA;
+    }
+    return clues;
+}
+
+int grid_populate(Grid *grid, const char *grid_str)
+{
+    PRINT_INFO("%s\n", __func__);
+
+    int clues = grid_check_str(grid_str);
+    GUARD(clues);
+    // symbols by row, column and box : a clue twice in a unit is found before any work
+    uint32_t units[3][N] = { { 0 } };
+    for (int i = 0; i < NN; i++) {
+        int n = grid_char_to_int(grid_str[i]);
+        if (n == NA) {
+            continue;
+        }
+        const uint32_t bit = (uint32_t)1 << n;
+        uint32_t *row = &units[0][i / N], *col = &units[1][i % N];
+        uint32_t *box = &units[2][(i / N / D) * D + i % N / D];
+        if ((*row | *col | *box) & bit) {
+            PRINT_INFO("%s invalid grid, clue in conflict in cell %d\n", __func__, i);
+            grid->invalid = 1;
+            return NA;
+        }
+        *row |= bit, *col |= bit, *box |= bit;
+    }
+    memset(grid->stage_stats, 0x00, sizeof(grid->stage_stats));
     for (int i = 0; i < NN; i++) {
         int n = grid_char_to_int(grid_str[i]);
         if (n != NA) {
-            clues++;
             int u = i * N + n;
             GUARD(grid_validate_enqueue(grid, u + 1));
         }
     }
-    if (D == 3 && clues < 17) {
-        PRINT_INFO("%s not enough clues\n", __func__);
-        return NA;
-    }
 
     PRINT_INFO("%s clues count %d\n", __func__, clues);
 
     return 0;
 }
 
-int grid_validate_purge(Grid *grid)
+int grid_assume_node(Grid *grid, NodeId node_id)
+{
+    if (grid->validated_nodes[node_id / N] == node_id) {
+        return 0;
+    }
+    // after merges the node is not necessarily in its own color
+    const IntVec *keys = cvmap_keys(&grid->color_to_nodes);
+    for (int i = 0, iend = ivec_size(keys); i < iend; i++) {
+        Color color = ivec_at_idx(keys, i);
+        if (ivec_find_first_from(cvmap_get_IntVec(&grid->color_to_nodes, color), 0, node_id) != NA) {
+            return grid_validate_enqueue(grid, color);
+        }
+    }
+    PRINT_INFO("%s node %d is not a candidate\n", __func__, node_id);
+    return NA;
+}
+
+// colors validated between two checks of the limits by grid_validate_purge_limited
+static const int kLimitsCheckColors = 8;
+
+// limited : stop between two colors once the limits expired, the colors left stay in the queue
+static int grid_validate_purge_colors(Grid *grid, int limited)
 {
     int result = 0;
+    for (int cnt = 1; ivec_size(&grid->to_validate) != 0; cnt++) {
+        if (limited && cnt % kLimitsCheckColors == 0 && grid_limits_expired(grid)) {
+            break;
+        }
 #ifdef CHECK_GRID
-    while (ivec_size(&grid->to_validate) != 0) {
-        Color color = ivec_at_idx(&grid->to_validate, 0);
-        ivec_erase_at_idx(&grid->to_validate, 0);
-        int ret = grid_validate_color(grid, color);
-        GUARD(ret);
-        result += ret;
-    }
+        int idx = 0;
 #else
-    int size = ivec_size(&grid->to_validate);
-    while (size != 0) {
-        Color color = ivec_at_idx(&grid->to_validate, size - 1);
-        ivec_erase_at_idx(&grid->to_validate, size - 1);
+        int idx = ivec_size(&grid->to_validate) - 1;
+#endif
+        Color color = ivec_at_idx(&grid->to_validate, idx);
+        ivec_erase_at_idx(&grid->to_validate, idx);
         int ret = grid_validate_color(grid, color);
         GUARD(ret);
         result += ret;
-        size = ivec_size(&grid->to_validate);
     }
-#endif
     return result;
 }
 
+int grid_validate_purge(Grid *grid)
+{
+    return grid_validate_purge_colors(grid, 0);
+}
+
+static int grid_validate_purge_limited(Grid *grid)
+{
+    return grid_validate_purge_colors(grid, 1);
+}
+
 int  grid_validate_color(Grid *grid, Color color)
 {
     assert(ivec_size(&grid->to_merge) == 0);
@@ -334,6 +443,7 @@ int  grid_validate_color(Grid *grid, Color color)
             GUARD(grid_validate_node(grid, node_id));
         }
         cvmap_erase(&grid->color_to_nodes, color);
+        grid->validated_cnt++;
 
         if (cvmap_count(&grid->color_to_exclusion_idx, color) != 0) {
             const IntVec *idxs = cvmap_get_IntVec(&grid->color_to_exclusion_idx, color);
@@ -363,6 +473,13 @@ int  grid_validate_color(Grid *grid, Color color)
     color = rev_color(color);
 
     if (cvmap_count(&grid->color_to_nodes, color) != 0) {
+        grid->eliminated_cnt += ivec_size(cvmap_get_IntVec(&grid->color_to_nodes, color));
+        if (grid->step) {
+            const IntVec *nodes = cvmap_get_IntVec(&grid->color_to_nodes, color);
+            for (int i = 0, iend = ivec_size(nodes); i < iend; i++) {
+                GUARD(ivec_push_back(&grid->step->eliminated, ivec_at_idx(nodes, i)));
+            }
+        }
 #ifdef CHECK_GRID
         const IntVec *colors = cvmap_get_IntVec(&grid->color_to_nodes, color);
         for (int i = 0, iend = ivec_size(colors); i < iend; i++) {
@@ -380,6 +497,11 @@ int  grid_validate_color(Grid *grid, Color color)
                 while ((idx_idx = ivec_find_first_from(&grid->color_exclusions[idx], idx_idx, color)) != NA) {
                     ivec_erase_at_idx(&grid->color_exclusions[idx], idx_idx);
                 }
+                // one color of a rule is true, the ones true clear it, none is left
+                if (ivec_size(&grid->color_exclusions[idx]) == 0) {
+                    PRINT_INFO("%s invalid grid, rule %d without color\n", __func__, idx);
+                    grid->invalid = 1;
+                }
             }
             cvmap_erase(&grid->color_to_exclusion_idx, color);
         }
@@ -388,69 +510,376 @@ int  grid_validate_color(Grid *grid, Color color)
     return 0;
 }
 
-// return NA in case of alloc faillure
-// and if CHECK_GRID is defined in case of invalid grid
-int grid_solve(Grid *grid)
-{
-    while (1) {
-        int ret = 0;
-        do {
-            GUARD(grid_validate_purge(grid));
-            ret = grid_validate_check_single(grid);
-            GUARD(ret);
-        } while (ret > 0);
+// stages run to a state with empty queues, so that any stage can follow
+// return NA as grid_solve, else the yield : colors validated or pairs merged
 
-        if (grid->validated_size == NN) {
-            return NN;
+// the only stage stopped by the limits with colors left in the queue, the next grid_solve goes on from there
+static int grid_stage_single(Grid *grid)
+{
+    int result = 0, ret = 0;
+    do {
+        GUARD(grid_validate_purge_limited(grid));
+        if (ivec_size(&grid->to_validate) != 0) {
+            break;
         }
-
-        do {
-            ret = grid_merge_check_pair(grid);
-            GUARD(ret);
-            if (ret > 0) {
-                GUARD(grid_merge_purge(grid));
-            }
-        } while(ret > 0);
-
-        ret = grid_validate_check_pair_1(grid);
+        ret = grid_validate_check_single(grid);
         GUARD(ret);
-        if (ret > 0) {
-            continue;
-        }
+        result += ret;
+    } while (ret > 0);
+    return result;
+}
 
-        ret = grid_validate_check_pair_2(grid);
+static int grid_stage_pair(Grid *grid)
+{
+    int result = 0, ret = 0;
+    do {
+        ret = grid_merge_check_pair(grid);
         GUARD(ret);
         if (ret > 0) {
-            continue;
+            GUARD(grid_merge_purge(grid));
         }
+        result += ret;
+    } while (ret > 0 && !grid_limits_expired(grid));
+    return result;
+}
+
+static int grid_stage_validate(Grid *grid, int (*check)(Grid *))
+{
+    int ret = check(grid);
+    GUARD(ret);
+    if (ret > 0) {
+        GUARD(grid_validate_purge(grid));
+    }
+    return ret;
+}
 
+static int grid_stage_pair_1(Grid *grid)
+{
+    return grid_stage_validate(grid, grid_validate_check_pair_1);
+}
+
+static int grid_stage_pair_2(Grid *grid)
+{
+    return grid_stage_validate(grid, grid_validate_check_pair_2);
+}
+
+// the adjacency list is only rebuilt after a change
+static int grid_stage_true_to_false(Grid *grid)
+{
+    if (grid->true_to_false_stale) {
         GUARD(grid_get_true_to_false_colors(grid));
+        grid->true_to_false_stale = 0;
+    }
+    return 0;
+}
 
-        ret = grid_merge_check_SCC(grid);
-        GUARD(ret);
-        if (ret > 0) {
-            GUARD(grid_merge_purge(grid));
-            continue;
+static int grid_stage_SCC(Grid *grid)
+{
+    GUARD(grid_stage_true_to_false(grid));
+    int ret = grid_merge_check_SCC(grid);
+    GUARD(ret);
+    if (ret > 0) {
+        GUARD(grid_merge_purge(grid));
+    }
+    return ret;
+}
+
+static int grid_stage_cycle(Grid *grid)
+{
+    GUARD(grid_stage_true_to_false(grid));
+    return grid_stage_validate(grid, grid_validate_check_cycle);
+}
+
+static int grid_stage_level_2(Grid *grid)
+{
+    GUARD(grid_stage_true_to_false(grid));
+    return grid_stage_validate(grid, grid_validate_check_cycle_level_2);
+}
+
+static const struct {
+    const char *name;
+    int (*run)(Grid *);
+} kStages[kStageCount] = {
+    { "single", grid_stage_single },
+    { "pair", grid_stage_pair },
+    { "pair1", grid_stage_pair_1 },
+    { "pair2", grid_stage_pair_2 },
+    { "scc", grid_stage_SCC },
+    { "cycle", grid_stage_cycle },
+    { "level2", grid_stage_level_2 }
+};
+
+static int grid_run_stage(Grid *grid, int stage)
+{
+    // no deduction from a contradiction
+    if (grid->invalid) {
+        return 0;
+    }
+    StageStats *stats = &grid->stage_stats[stage];
+    const long validated_cnt = grid->validated_cnt, merged_cnt = grid->merged_cnt;
+    const long eliminated_cnt = grid->eliminated_cnt, vertex_cnt = grid->vertex_cnt;
+    uint64_t perf_start[kPerfCount], perf_end[kPerfCount];
+    if (grid->perf) {
+        perf_read(grid->perf, perf_start);
+    }
+    const int64_t start = timing_now_ns();
+    int ret = kStages[stage].run(grid);
+    stats->ns += timing_now_ns() - start;
+    if (grid->perf) {
+        perf_read(grid->perf, perf_end);
+        for (int i = 0; i < kPerfCount; i++) {
+            stats->perf[i] += perf_end[i] - perf_start[i];
         }
+    }
+    stats->validated += grid->validated_cnt - validated_cnt;
+    stats->merged += grid->merged_cnt - merged_cnt;
+    stats->eliminated += grid->eliminated_cnt - eliminated_cnt;
+    stats->vertices += grid->vertex_cnt - vertex_cnt;
+    if (grid->limits) {
+        // counted before the grid is copied, not twice
+        grid->limits->op_cnt += grid->vertex_cnt - grid->limit_vertex_cnt;
+        grid->limit_vertex_cnt = grid->vertex_cnt;
+    }
+    GUARD(ret);
+    stats->calls++;
+    stats->yield += ret;
+    stats->misses = (ret > 0 ? 0 : stats->misses + 1);
+    if (ret > 0) {
+        grid->true_to_false_stale = 1;
+        grid->stalled_stages = 0;
+    } else if (!grid_limits_expired(grid)) {
+        // a stage stopped by the limits is not done
+        grid->stalled_stages |= 1u << stage;
+    }
+    return ret;
+}
 
-        ret = grid_validate_check_cycle(grid);
-        GUARD(ret);
-        if (ret > 0) {
-            continue;
+void grid_set_perf(Grid *grid, const PerfCounters *perf)
+{
+    grid->perf = perf;
+}
+
+void grid_set_limits(Grid *grid, GridLimits *limits)
+{
+    grid->limits = limits;
+    grid->limit_vertex_cnt = grid->vertex_cnt;
+}
+
+void grid_limits_reset(GridLimits *limits, int64_t deadline_ns, long op_budget)
+{
+    limits->deadline_ns = deadline_ns;
+    limits->op_budget = op_budget;
+    limits->op_cnt = 0;
+    limits->expired = 0;
+}
+
+int grid_limits_expired(Grid *grid)
+{
+    GridLimits *limits = grid->limits;
+    if (!limits) {
+        return 0;
+    }
+    if (!limits->expired) {
+        limits->op_cnt += grid->vertex_cnt - grid->limit_vertex_cnt;
+        grid->limit_vertex_cnt = grid->vertex_cnt;
+        limits->expired = (limits->op_budget != 0 && limits->op_cnt >= limits->op_budget)
+                          || (limits->deadline_ns != 0 && timing_now_ns() >= limits->deadline_ns);
+    }
+    return limits->expired;
+}
+
+void grid_set_stages(Grid *grid, unsigned stage_mask, int adaptive)
+{
+    grid->stage_mask = (stage_mask & kStageAll) | (1u << kStageSingle);
+    grid->adaptive = adaptive;
+}
+
+const char *grid_stage_name(int stage)
+{
+    return (stage >= 0 && stage < kStageCount) ? kStages[stage].name : "unknown";
+}
+
+int grid_stage_from_name(const char *name)
+{
+    for (int stage = 0; stage < kStageCount; stage++) {
+        if (strcmp(name, kStages[stage].name) == 0) {
+            return stage;
+        }
+    }
+    return NA;
+}
+
+// adaptive : a stage without yield in its last runs is deferred when the next stage enabled
+// yields more by ns, so the cheap stages and the last one are rarely deferred
+static int grid_stage_deferrable(const Grid *grid, int stage)
+{
+    const StageStats *stats = &grid->stage_stats[stage];
+    if (stats->misses < kStageMissesToDefer) {
+        return 0;
+    }
+    for (int next = stage + 1; next < kStageCount; next++) {
+        if (grid->stage_mask & (1u << next)) {
+            const StageStats *n_stats = &grid->stage_stats[next];
+            return n_stats->calls > 0 && (double)stats->yield * n_stats->ns < (double)n_stats->yield * stats->ns;
+        }
+    }
+    return 0;
+}
+
+void grid_stats_add(StageStats dst[kStageCount], const StageStats src[kStageCount], const StageStats base[kStageCount])
+{
+    static const StageStats zero;
+    for (int stage = 0; stage < kStageCount; stage++) {
+        const StageStats *s = &src[stage], *b = (base ? &base[stage] : &zero);
+        StageStats *d = &dst[stage];
+        d->calls += s->calls - b->calls;
+        d->yield += s->yield - b->yield;
+        d->validated += s->validated - b->validated;
+        d->merged += s->merged - b->merged;
+        d->eliminated += s->eliminated - b->eliminated;
+        d->vertices += s->vertices - b->vertices;
+        d->ns += s->ns - b->ns;
+        for (int i = 0; i < kPerfCount; i++) {
+            d->perf[i] += s->perf[i] - b->perf[i];
+        }
+        d->deferred += s->deferred - b->deferred;
+    }
+}
+
+void grid_stats_print_json(FILE *f, const StageStats stats[kStageCount])
+{
+    fprintf(f, "{");
+    for (int stage = 0; stage < kStageCount; stage++) {
+        const StageStats *s = &stats[stage];
+        fprintf(f, "%s\"%s\":{\"calls\":%ld,\"yield\":%ld,\"validated\":%ld,\"merged\":%ld,"
+                "\"eliminated\":%ld,\"vertices\":%ld,\"ns\":%ld,\"deferred\":%ld",
+                stage == 0 ? "" : ",", kStages[stage].name, s->calls, s->yield, s->validated, s->merged,
+                s->eliminated, s->vertices, s->ns, s->deferred);
+        for (int i = 0; i < kPerfCount; i++) {
+            fprintf(f, ",\"%s\":%ld", perf_counter_name(i), s->perf[i]);
         }
+        fprintf(f, "}");
+    }
+    fprintf(f, "}");
+}
+
+int grid_solve_pairs(Grid *grid)
+{
+    GUARD(grid_run_stage(grid, kStageSingle));
+    if (grid->validated_size == NN) {
+        return NN;
+    }
+    // stopped by the limits, the merges need an empty queue
+    if (ivec_size(&grid->to_validate) != 0) {
+        return grid->validated_size;
+    }
+    if (grid->stage_mask & (1u << kStagePair)) {
+        GUARD(grid_run_stage(grid, kStagePair));
+    }
+    return grid->validated_size;
+}
 
-        ret = grid_validate_check_cycle_level_2(grid);
+// return NA in case of alloc faillure
+// and if CHECK_GRID is defined in case of invalid grid
+int grid_solve(Grid *grid)
+{
+    // the rules may have changed since the last call
+    grid->true_to_false_stale = 1;
+    // colors enqueued since (grid_populate, grid_assume_node) : every stage may yield again
+    if (ivec_size(&grid->to_validate) != 0 || ivec_size(&grid->to_merge) != 0) {
+        grid->stalled_stages = 0;
+    }
+    while (1) {
+        int ret = grid_solve_pairs(grid);
         GUARD(ret);
-        if (ret > 0) {
-            continue;
+        if (ret == NN) {
+            return NN;
+        }
+        // the queues are flushed, stop there
+        if (grid_limits_expired(grid)) {
+            break;
         }
 
-        break;
+        // first stage with a yield restarts from the singles
+        // 2d pass for the stages deferred in the 1st one, when nothing else yields
+        unsigned deferred = 0;
+        int progress = 0;
+        for (int pass = 0; pass < 2 && !progress; pass++) {
+            for (int stage = kStagePair1; stage < kStageCount && !progress; stage++) {
+                const unsigned bit = 1u << stage;
+                // a stage stalled since the last change, as left by a grid_solve parked before, has nothing more
+                if (!(grid->stage_mask & bit) || (grid->stalled_stages & bit) || (pass == 1 && !(deferred & bit))) {
+                    continue;
+                }
+                if (pass == 0 && grid->adaptive && grid_stage_deferrable(grid, stage)) {
+                    deferred |= bit;
+                    grid->stage_stats[stage].deferred++;
+                    continue;
+                }
+                ret = grid_run_stage(grid, stage);
+                GUARD(ret);
+                progress = (ret > 0);
+            }
+        }
+        if (!progress) {
+            break;
+        }
     }
 
     return grid->validated_size;
 }
 
+void grid_step_init(GridStep *step)
+{
+    step->stage = NA;
+    step->yield = 0;
+    ivec_init(&step->validated);
+    ivec_init(&step->eliminated);
+}
+
+void grid_step_free(GridStep *step)
+{
+    ivec_free(&step->validated);
+    ivec_free(&step->eliminated);
+}
+
+int grid_next_step(Grid *grid, GridStep *step)
+{
+    step->stage = NA;
+    step->yield = 0;
+    ivec_clear(&step->validated);
+    ivec_clear(&step->eliminated);
+    if (grid->validated_size == NN || grid_limits_expired(grid)) {
+        return 0;
+    }
+    // colors enqueued since (grid_populate, grid_assume_node) : every stage may yield again
+    // they are given, not deduced, flushed before the step logs anything
+    if (ivec_size(&grid->to_validate) != 0 || ivec_size(&grid->to_merge) != 0) {
+        GUARD(grid_validate_purge(grid));
+        GUARD(grid_merge_purge(grid));
+        grid->true_to_false_stale = 1;
+        grid->stalled_stages = 0;
+    }
+    grid->step = step;
+    int ret = 0;
+    for (int stage = kStageSingle; stage < kStageCount && ret == 0 && ivec_size(&grid->to_validate) == 0; stage++) {
+        const unsigned bit = 1u << stage;
+        if (!(grid->stage_mask & bit) || (grid->stalled_stages & bit)) {
+            continue;
+        }
+        ret = grid_run_stage(grid, stage);
+        step->stage = stage;
+    }
+    grid->step = NULL;
+    GUARD(ret);
+    if (ret == 0) {
+        step->stage = NA;
+        return 0;
+    }
+    step->yield = ret;
+    return 1;
+}
+
 int grid_validate_check_single(Grid *grid)
 {
     PRINT_INFO("%s\n", __func__);
@@ -469,12 +898,13 @@ int grid_validate_check_single(Grid *grid)
 int grid_merge_enqueue(Grid *grid, const Color colors[2])
 { 
     if (abs_color(colors[0]) == abs_color(colors[1])) {
-#ifdef CHECK_GRID
         if ((colors[0] < 0) != (colors[1] < 0)) {
             PRINT_INFO("%s invalid grid merging reverse colors\n", __func__);
+            grid->invalid = 1;
+#ifdef CHECK_GRID
             return NA;
-        }
 #endif
+        }
         return 0;
     }
     if (ivec_absolute_pair_exists(&grid->to_merge, colors) == NA) {
@@ -538,16 +968,18 @@ int grid_merge_colors(Grid *grid, const Color colors[2])
     assert(ivec_size(&grid->to_validate) == 0);
 
     if (abs_color(colors[0]) == abs_color(colors[1])) {
-#ifdef CHECK_GRID
         if ((colors[0] < 0) != (colors[1] < 0)) {
             PRINT_INFO("%s invalid grid\n", __func__);
+            grid->invalid = 1;
+#ifdef CHECK_GRID
             return NA;
-        }
 #endif
+        }
         return 0;
     }
 
     PRINT_INFO("%s %+4d %+4d\n", __func__, colors[0], colors[1]);
+    grid->merged_cnt++;
 
     Color src = colors[0], dst = colors[1];
     for (int i = 0; i < 2; i++) {
@@ -683,14 +1115,14 @@ int grid_get_true_to_false_colors(Grid *grid)
 
 typedef struct SCCSearch {
     VertexMap indices, low_links;
-    IntVec stack_color, stack_polarity;
+    IntVec *stack_color, *stack_polarity; // the grid scratch
 } SCCSearch;
 
 static int ss_on_stack(const SCCSearch *ss, const Vertex *v)
 {
     int idx = 0;
-    while ((idx = ivec_find_first_from(&ss->stack_color, idx, v->first)) != NA) {
-        if (ivec_at_idx(&ss->stack_polarity, idx) == v->second) {
+    while ((idx = ivec_find_first_from(ss->stack_color, idx, v->first)) != NA) {
+        if (ivec_at_idx(ss->stack_polarity, idx) == v->second) {
             return idx;
         }
         idx++;
@@ -702,14 +1134,15 @@ static int ss_on_stack(const SCCSearch *ss, const Vertex *v)
 static int ss_strong_connect(Grid *grid, SCCSearch *ss, Vertex v, int cur_index)
 {
     int result = 0;
+    grid->vertex_cnt++;
 
     vmap_assign(&ss->indices, &v, cur_index);
     vmap_assign(&ss->low_links, &v, cur_index);
 
     cur_index = cur_index + 1;
 
-    GUARD(ivec_push_back(&ss->stack_color, v.first));
-    GUARD(ivec_push_back(&ss->stack_polarity, v.second));
+    GUARD(ivec_push_back(ss->stack_color, v.first));
+    GUARD(ivec_push_back(ss->stack_polarity, v.second));
 
     Vertex w;
     w.second = !v.second;
@@ -736,11 +1169,11 @@ static int ss_strong_connect(Grid *grid, SCCSearch *ss, Vertex v, int cur_index)
         int cnt = 0;
         Color colors[2];
         do {
-            int size = ivec_size(&ss->stack_color);
-            y.first = ivec_at_idx(&ss->stack_color, size - 1);
-            ivec_erase_at_idx(&ss->stack_color, size - 1);
-            y.second = ivec_at_idx(&ss->stack_polarity, size - 1);
-            ivec_erase_at_idx(&ss->stack_polarity, size - 1);
+            int size = ivec_size(ss->stack_color);
+            y.first = ivec_at_idx(ss->stack_color, size - 1);
+            ivec_erase_at_idx(ss->stack_color, size - 1);
+            y.second = ivec_at_idx(ss->stack_polarity, size - 1);
+            ivec_erase_at_idx(ss->stack_polarity, size - 1);
             if (cnt == 0) {
                 colors[0] = (y.second ? y.first : rev_color(y.first));
             } else {
@@ -764,8 +1197,10 @@ int grid_merge_check_SCC(Grid *grid)
     // init
     vmap_clear(&ss.indices);
     vmap_clear(&ss.low_links);
-    ivec_init(&ss.stack_color);
-    ivec_init(&ss.stack_polarity);
+    ss.stack_color = &grid->scc_stack_color;
+    ss.stack_polarity = &grid->scc_stack_polarity;
+    ivec_clear(ss.stack_color);
+    ivec_clear(ss.stack_polarity);
 
     const int cur_index = 1;
     const IntVec *keys = cvmap_keys(&grid->color_to_nodes);
@@ -782,15 +1217,12 @@ int grid_merge_check_SCC(Grid *grid)
         }
     }
 
-    // clean up
-    ivec_free(&ss.stack_color);
-    ivec_free(&ss.stack_polarity);
-
     return result;
 }
 
 static int grid_validate_check_cycle_dfs(Grid *grid, VertexMap *visited, IntVec *excl_color_cnt, Vertex v)
 {
+    grid->vertex_cnt++;
     vmap_assign(visited, &v, 1);
 
     // use exclusion rule constraint during the search
@@ -839,32 +1271,41 @@ static int grid_validate_check_cycle_dfs(Grid *grid, VertexMap *visited, IntVec
     return 0;
 }
 
+// index of the cursor color in the keys, NA if it is 0 or not a color anymore
+static int grid_cursor_index(const IntVec *keys, Color cursor)
+{
+    return cursor != 0 ? ivec_find_first_from(keys, 0, cursor) : NA;
+}
+
 int grid_validate_check_cycle(Grid *grid)
 {
     PRINT_INFO("%s\n", __func__);
     int result = 0;
-    IntVec excl_color_cnt_base;
-    ivec_init(&excl_color_cnt_base);
+    IntVec *excl_color_cnt_base = &grid->excl_color_cnt_base;
+    ivec_clear(excl_color_cnt_base);
     for (int idx = 0; idx < kUnitCount * NN; idx++) {
-        if (ivec_push_back(&excl_color_cnt_base, ivec_size(&grid->color_exclusions[idx])) == NA) {
-            ivec_free(&excl_color_cnt_base);
-            return NA;
-        }
+        GUARD(ivec_push_back(excl_color_cnt_base, ivec_size(&grid->color_exclusions[idx])));
     }
-    IntVec excl_color_cnt;
-    ivec_init(&excl_color_cnt);
+    IntVec *excl_color_cnt = &grid->excl_color_cnt;
     VertexMap visited;
 
     const IntVec *keys = cvmap_keys(&grid->color_to_nodes);
-    for (int i = 0, iend = ivec_size(keys); i < iend; i++) {
+    const int start = grid_cursor_index(keys, grid->cycle_cursor);
+    grid->cycle_cursor = 0;
+    for (int n = 0, iend = ivec_size(keys); n < iend; n++) {
+        const int i = (start == NA ? n : (start + n) % iend);
         Color color = ivec_at_idx(keys, i);
+        if (grid_limits_expired(grid)) {
+            grid->cycle_cursor = color;
+            break;
+        }
         Vertex v = { color, 1 };
-        if (ivec_copy(&excl_color_cnt_base, &excl_color_cnt) == NA) {
+        if (ivec_copy(excl_color_cnt_base, excl_color_cnt) == NA) {
             result = NA;
             break;
         }
         vmap_clear(&visited);
-        if (grid_validate_check_cycle_dfs(grid, &visited, &excl_color_cnt, v) == 1) {
+        if (grid_validate_check_cycle_dfs(grid, &visited, excl_color_cnt, v) == 1) {
             int ret = grid_validate_enqueue(grid, rev_color(color));
             if (ret == NA) {
                 result = NA;
@@ -874,9 +1315,6 @@ int grid_validate_check_cycle(Grid *grid)
         }
     }
 
-    ivec_free(&excl_color_cnt);
-    ivec_free(&excl_color_cnt_base);
-
     return result;
 }
 
@@ -884,60 +1322,67 @@ int grid_validate_check_cycle_level_2(Grid *grid)
 {
     PRINT_INFO("%s\n", __func__);
     int result = 0;
-    IntVec excl_color_cnt_base;
-    ivec_init(&excl_color_cnt_base);
+    IntVec *excl_color_cnt_base = &grid->excl_color_cnt_base;
+    ivec_clear(excl_color_cnt_base);
     for (int idx = 0; idx < kUnitCount * NN; idx++) {
-        if (ivec_push_back(&excl_color_cnt_base, ivec_size(&grid->color_exclusions[idx])) == NA) {
-            ivec_free(&excl_color_cnt_base);
-            return NA;
-        }
+        GUARD(ivec_push_back(excl_color_cnt_base, ivec_size(&grid->color_exclusions[idx])));
     }
-    IntVec excl_color_cnt;
-    ivec_init(&excl_color_cnt);
-    IntVec excl_color_cnt_bak;
-    ivec_init(&excl_color_cnt_bak);
+    IntVec *excl_color_cnt = &grid->excl_color_cnt;
+    IntVec *excl_color_cnt_bak = &grid->excl_color_cnt_bak;
     VertexMap visited, visited_bak;
 
     const IntVec *keys = cvmap_keys(&grid->color_to_nodes);
-    for (int i = 0, iend = ivec_size(keys); i < iend; i++) {
+    const int start = grid_cursor_index(keys, grid->level2_cursor[0]);
+    // the probe cursor is only for the root it was saved with
+    int probe_start = (start == NA ? NA : grid_cursor_index(keys, grid->level2_cursor[1]));
+    grid->level2_cursor[0] = grid->level2_cursor[1] = 0;
+    for (int n = 0, iend = ivec_size(keys); n < iend; n++) {
+        const int i = (start == NA ? n : (start + n) % iend);
         Color color = ivec_at_idx(keys, i);
         Vertex v = { color, 1 };
-        if (ivec_copy(&excl_color_cnt_base, &excl_color_cnt) == NA) {
+        if (ivec_copy(excl_color_cnt_base, excl_color_cnt) == NA) {
             result = NA;
             break;
         }
         vmap_clear(&visited);
         // 1st level : A true => colors reachable in true or false state
-        if (grid_validate_check_cycle_dfs(grid, &visited, &excl_color_cnt, v) != 0) {
-            PRINT_INFO("%s Check cycle level 1 before, stopping search now\n", __func__);
-            result = NA;
+        // a contradiction there is one grid_validate_check_cycle finds, the stage may have been deferred
+        if (grid_validate_check_cycle_dfs(grid, &visited, excl_color_cnt, v) != 0) {
+            result = grid_validate_enqueue(grid, rev_color(color));
             break;
         }
         // 2d level : B and -B true are not reachable by A.
         // B true => A false, -B true => A false, and B true XOR -B true :  => A false
         visited_bak = visited;
-        if (ivec_copy(&excl_color_cnt, &excl_color_cnt_bak) == NA) {
+        if (ivec_copy(excl_color_cnt, excl_color_cnt_bak) == NA) {
             result = NA;
             break;
         }
-        for (int j = 0; j < iend; j++) {
+        // the probes are the O(K^2) part, the limits are checked by probe
+        for (int m = 0; m < iend; m++) {
+            const int j = (probe_start == NA ? m : (probe_start + m) % iend);
             Color o_color = ivec_at_idx(keys, j);
+            if (grid_limits_expired(grid)) {
+                grid->level2_cursor[0] = color;
+                grid->level2_cursor[1] = o_color;
+                break;
+            }
             if (color == o_color || color == rev_color(o_color)) {
                 continue;
             }
             Vertex ws[2] = { {o_color, 1}, {rev_color(o_color), 1} };
             visited = visited_bak;
-            if (ivec_copy(&excl_color_cnt_bak, &excl_color_cnt) == NA) {
+            if (ivec_copy(excl_color_cnt_bak, excl_color_cnt) == NA) {
                 result = NA;
                 break;
             }
-            if (grid_validate_check_cycle_dfs(grid, &visited, &excl_color_cnt, ws[0]) == 1) {
+            if (grid_validate_check_cycle_dfs(grid, &visited, excl_color_cnt, ws[0]) == 1) {
                 visited = visited_bak;
-                if (ivec_copy(&excl_color_cnt_bak, &excl_color_cnt) == NA) {
+                if (ivec_copy(excl_color_cnt_bak, excl_color_cnt) == NA) {
                     result = NA;
                     break;
                 }
-                if (grid_validate_check_cycle_dfs(grid, &visited, &excl_color_cnt, ws[1]) == 1) {
+                if (grid_validate_check_cycle_dfs(grid, &visited, excl_color_cnt, ws[1]) == 1) {
                     int ret = grid_validate_enqueue(grid, rev_color(color));
                     if (ret == NA) {
                         result = NA;
@@ -950,19 +1395,26 @@ int grid_validate_check_cycle_level_2(Grid *grid)
                 }
             }
         }
+        probe_start = NA;
         // search is costly, break early
-        if (result != 0) {
+        if (result != 0 || grid->level2_cursor[0] != 0) {
+            break;
+        }
+        if (grid_limits_expired(grid)) {
+            // the next root, none if this one was the last
+            grid->level2_cursor[0] = (n + 1 < iend ? ivec_at_idx(keys, (i + 1) % iend) : 0);
             break;
         }
     }
 
-    ivec_free(&excl_color_cnt);
-    ivec_free(&excl_color_cnt_base);
-    ivec_free(&excl_color_cnt_bak);
-
     return result;
 }
 
+int grid_color_count(Grid *grid)
+{
+    return ivec_size(cvmap_keys(&grid->color_to_nodes));
+}
+
 void grid_get_grid_str(Grid *grid, char str[NN + 1])
 {
     for (int i = 0; i < NN; i++) {
@@ -972,6 +1424,43 @@ void grid_get_grid_str(Grid *grid, char str[NN + 1])
     str[NN] = '\0';
 }
 
+int grid_pack_str(const char *grid_str, uint8_t packed[kPackedSize])
+{
+    if (strlen(grid_str) != NN) {
+        return NA;
+    }
+    memset(packed, 0x00, kPackedSize);
+    for (int i = 0; i < NN; i++) {
+        int n = grid_char_to_int(grid_str[i]);
+        unsigned v = (n == NA ? 0 : n + 1);
+        int bit = i * kCellBits;
+        // a cell can straddle two bytes
+        packed[bit / 8] |= (uint8_t)(v << (bit % 8));
+        if (bit % 8 + kCellBits > 8) {
+            packed[bit / 8 + 1] |= (uint8_t)(v >> (8 - bit % 8));
+        }
+    }
+    return 0;
+}
+
+int grid_unpack_str(const uint8_t packed[kPackedSize], char str[NN + 1])
+{
+    for (int i = 0; i < NN; i++) {
+        int bit = i * kCellBits;
+        unsigned v = packed[bit / 8] >> (bit % 8);
+        if (bit % 8 + kCellBits > 8) {
+            v |= (unsigned)packed[bit / 8 + 1] << (8 - bit % 8);
+        }
+        v &= (1u << kCellBits) - 1;
+        if (v > N) {
+            return NA;
+        }
+        str[i] = (v == 0 ? '.' : int_to_grid_char(v - 1));
+    }
+    str[NN] = '\0';
+    return 0;
+}
+
 void grid_get_cands_str(Grid *grid, char str[NN * N + 1])
 {
     memset(str, '.', NN * N);
@@ -993,3 +1482,287 @@ void grid_get_cands_str(Grid *grid, char str[NN * N + 1])
         }
     }
 }
+
+/*****************************************************************/
+
+typedef struct
+{
+    uint8_t *blob;
+    long size; // of blob
+    long pos; // bytes of the state, past size when blob is too small
+} SaveWriter;
+
+typedef struct
+{
+    const uint8_t *blob;
+    long size;
+    long pos;
+    int error; // truncated or a value out of range, the values read after are 0
+} SaveReader;
+
+static void save_put(SaveWriter *w, uint64_t v)
+{
+    do {
+        uint8_t byte = v & 0x7F;
+        v >>= 7;
+        if (w->pos < w->size) {
+            w->blob[w->pos] = byte | (v ? 0x80 : 0x00);
+        }
+        w->pos++;
+    } while (v);
+}
+
+// zigzag : the small colors of both signs on one byte
+static uint64_t save_zigzag(Color color)
+{
+    return color < 0 ? ((uint64_t)-(color + 1) << 1) | 1 : (uint64_t)color << 1;
+}
+
+static void save_put_ivec(SaveWriter *w, const IntVec *vec, int colors)
+{
+    save_put(w, vec->size);
+    for (int i = 0; i < vec->size; i++) {
+        if (colors) {
+            save_put(w, save_zigzag(vec->store[i]));
+        } else {
+            save_put(w, vec->store[i]);
+        }
+    }
+}
+
+// the keys as listed, the erased ones included with a 0 marked bit : a key inserted again keeps its place
+// in the list, so cvmap_keys gives the same order after grid_load
+static void save_put_cvmap(SaveWriter *w, const ColorVecMap *cvm, int colors)
+{
+    save_put(w, cvm->list.size);
+    for (int i = 0; i < cvm->list.size; i++) {
+        const Color color = cvm->list.store[i];
+        save_put(w, save_zigzag(color) << 1 | (cvm->marked[color_to_idx(color)] ? 1 : 0));
+    }
+    for (int i = 0; i < cvm->list.size; i++) {
+        const int idx = color_to_idx(cvm->list.store[i]);
+        if (cvm->marked[idx]) {
+            save_put_ivec(w, &cvm->store[idx], colors);
+        }
+    }
+}
+
+long grid_save(const Grid *grid, uint8_t *blob, long size)
+{
+    SaveWriter w = { blob, size, 0 };
+    const uint8_t header[kSaveHeaderSize] = {
+        kSaveMagic0, kSaveMagic1, kSaveMagic2, kSaveVersion, D,
+#ifdef CHECK_GRID
+        kSaveFlagCheck
+#else
+        0
+#endif
+    };
+    for (int i = 0; i < kSaveHeaderSize; i++) {
+        if (w.pos < size) {
+            blob[w.pos] = header[i];
+        }
+        w.pos++;
+    }
+    save_put(&w, grid->validated_size);
+    for (int i = 0; i < NN; i++) {
+        save_put(&w, grid->validated_nodes[i] + 1);
+    }
+    save_put_cvmap(&w, &grid->color_to_nodes, 0);
+    save_put_cvmap(&w, &grid->color_to_exclusion_idx, 0);
+    for (int i = 0; i < NN * 4; i++) {
+        save_put_ivec(&w, &grid->color_exclusions[i], 1);
+    }
+    save_put_ivec(&w, &grid->to_validate, 1);
+    save_put_ivec(&w, &grid->to_merge, 1);
+    save_put(&w, grid->stage_mask);
+    save_put(&w, grid->adaptive);
+    for (int stage = 0; stage < kStageCount; stage++) {
+        const StageStats *stats = &grid->stage_stats[stage];
+        save_put(&w, stats->calls);
+        save_put(&w, stats->yield);
+        save_put(&w, stats->validated);
+        save_put(&w, stats->merged);
+        save_put(&w, stats->eliminated);
+        save_put(&w, stats->vertices);
+        save_put(&w, stats->ns);
+        for (int i = 0; i < kPerfCount; i++) {
+            save_put(&w, stats->perf[i]);
+        }
+        save_put(&w, stats->deferred);
+        save_put(&w, stats->misses);
+    }
+    save_put(&w, grid->validated_cnt);
+    save_put(&w, grid->merged_cnt);
+    save_put(&w, grid->eliminated_cnt);
+    save_put(&w, grid->vertex_cnt);
+    save_put(&w, grid->stalled_stages);
+    save_put(&w, save_zigzag(grid->cycle_cursor));
+    save_put(&w, save_zigzag(grid->level2_cursor[0]));
+    save_put(&w, save_zigzag(grid->level2_cursor[1]));
+#ifdef CHECK_GRID
+    for (int i = 0; i < kConstraintCount; i++) {
+        for (int j = 0; j < NN; j++) {
+            save_put(&w, grid->constraint_cnt_check[i][j]);
+        }
+    }
+#endif
+    return w.pos;
+}
+
+static uint64_t load_get(SaveReader *r)
+{
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (r->pos >= r->size) {
+            break;
+        }
+        const uint8_t byte = r->blob[r->pos++];
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return v;
+        }
+    }
+    r->error = 1;
+    return 0;
+}
+
+// a value in [lo, hi], else error
+static long load_get_range(SaveReader *r, long lo, long hi)
+{
+    const long v = (long)load_get(r);
+    if (v < lo || v > hi) {
+        r->error = 1;
+        return lo;
+    }
+    return v;
+}
+
+static Color load_color(SaveReader *r, uint64_t v)
+{
+    const long color = (v & 1) ? -(long)(v >> 1) - 1 : (long)(v >> 1);
+    if (color == 0 || color < -N * NN || color > N * NN) {
+        r->error = 1;
+        return 1;
+    }
+    return color;
+}
+
+// a color or 0 for a cursor at the first color
+static Color load_cursor(SaveReader *r)
+{
+    const uint64_t v = load_get(r);
+    return v == 0 ? 0 : load_color(r, v);
+}
+
+// a vector can not have more values than bytes left
+// return NA if alloc fails
+static int load_ivec(SaveReader *r, IntVec *vec, int colors, int hi)
+{
+    ivec_clear(vec);
+    const long size = load_get_range(r, 0, r->size - r->pos);
+    for (long i = 0; i < size && !r->error; i++) {
+        GUARD(ivec_push_back(vec, colors ? load_color(r, load_get(r)) : (int)load_get_range(r, 0, hi)));
+    }
+    return 0;
+}
+
+// marked is 2 for a key listed and kept, 1 for a key listed and erased while the list is read,
+// so that a key listed twice is an error
+// return NA if alloc fails
+static int load_cvmap(SaveReader *r, ColorVecMap *cvm, int colors, int hi)
+{
+    cvmap_clear(cvm);
+    const long size = load_get_range(r, 0, 2 * N * NN);
+    for (long i = 0; i < size && !r->error; i++) {
+        const uint64_t v = load_get(r);
+        const Color color = load_color(r, v >> 1);
+        const int idx = color_to_idx(color);
+        if (cvm->marked[idx]) {
+            r->error = 1;
+            break;
+        }
+        cvm->marked[idx] = 1 + (v & 1);
+        GUARD(ivec_push_back(&cvm->list, color));
+    }
+    for (int i = 0; i < cvm->list.size; i++) {
+        const int idx = color_to_idx(cvm->list.store[i]);
+        cvm->marked[idx]--;
+        if (cvm->marked[idx] && !r->error) {
+            GUARD(load_ivec(r, &cvm->store[idx], colors, hi));
+        }
+    }
+    return 0;
+}
+
+int grid_load(Grid *grid, const uint8_t *blob, long size)
+{
+    const uint8_t flags =
+#ifdef CHECK_GRID
+        kSaveFlagCheck;
+#else
+        0;
+#endif
+    if (size < kSaveHeaderSize || blob[0] != kSaveMagic0 || blob[1] != kSaveMagic1 || blob[2] != kSaveMagic2
+            || blob[3] != kSaveVersion || blob[4] != D || blob[5] != flags) {
+        return NA;
+    }
+    SaveReader r = { blob, size, kSaveHeaderSize, 0 };
+    grid->validated_size = load_get_range(&r, 0, NN);
+    for (int i = 0; i < NN; i++) {
+        const NodeId node_id = load_get_range(&r, 0, N * NN) - 1;
+        if (node_id != NA && node_id / N != i) {
+            r.error = 1;
+        }
+        grid->validated_nodes[i] = node_id;
+    }
+    GUARD(load_cvmap(&r, &grid->color_to_nodes, 0, N * NN - 1));
+    GUARD(load_cvmap(&r, &grid->color_to_exclusion_idx, 0, NN * 4 - 1));
+    for (int i = 0; i < NN * 4; i++) {
+        GUARD(load_ivec(&r, &grid->color_exclusions[i], 1, 0));
+    }
+    GUARD(load_ivec(&r, &grid->to_validate, 1, 0));
+    GUARD(load_ivec(&r, &grid->to_merge, 1, 0));
+    if (grid->to_merge.size % 2 != 0) {
+        r.error = 1;
+    }
+    grid->stage_mask = load_get_range(&r, 0, kStageAll);
+    grid->adaptive = load_get_range(&r, 0, 1);
+    for (int stage = 0; stage < kStageCount; stage++) {
+        StageStats *stats = &grid->stage_stats[stage];
+        stats->calls = load_get(&r);
+        stats->yield = load_get(&r);
+        stats->validated = load_get(&r);
+        stats->merged = load_get(&r);
+        stats->eliminated = load_get(&r);
+        stats->vertices = load_get(&r);
+        stats->ns = load_get(&r);
+        for (int i = 0; i < kPerfCount; i++) {
+            stats->perf[i] = load_get(&r);
+        }
+        stats->deferred = load_get(&r);
+        stats->misses = load_get_range(&r, 0, INT_MAX);
+    }
+    grid->validated_cnt = load_get(&r);
+    grid->merged_cnt = load_get(&r);
+    grid->eliminated_cnt = load_get(&r);
+    grid->vertex_cnt = load_get(&r);
+    grid->stalled_stages = load_get_range(&r, 0, kStageAll);
+    grid->cycle_cursor = load_cursor(&r);
+    grid->level2_cursor[0] = load_cursor(&r);
+    grid->level2_cursor[1] = load_cursor(&r);
+#ifdef CHECK_GRID
+    for (int i = 0; i < kConstraintCount; i++) {
+        for (int j = 0; j < NN; j++) {
+            grid->constraint_cnt_check[i][j] = load_get_range(&r, 0, NN);
+        }
+    }
+#endif
+    if (r.error || r.pos != size) {
+        return NA;
+    }
+    grid->true_to_false_stale = 1;
+    grid->limit_vertex_cnt = grid->vertex_cnt;
+    grid->invalid = 0;
+    return 0;
+}
@@ -22,6 +22,7 @@
 
 #include "consts.h"
 #include "customtypes.h"
+#include "perf.h"
 
 /*
  * Summary:
@@ -34,10 +35,93 @@
  *
  * Use exclusion rules only, rules created using the fact that 1 and only 1 node is true in a unit
  *
- * Adjust D in consts.h at compile time, set D to 3 for 9x9 sudoku, to 4 for 16x16
- * For D > 4, grid_populate and grid_get_grid_str are not implemented.
+ * Adjust D in consts.h at compile time, set D to 3 for 9x9 sudoku, to 4 for 16x16, to 5 for 25x25
+ *
+ * Cell encoding in grid strings :
+ * D = 3 : [1-9], any other character is an empty cell
+ * D = 4 : [0-9] then [A-F], D = 5 : [0-9] then [A-O], lower case accepted in input,
+ *         any other character ('.' by convention) is an empty cell
+ * Packed grid : kCellBits bits by cell in string order, little endian bit order,
+ *               0 for an empty cell, symbol index + 1 otherwise
+ *
+ * grid_solve runs a table of stages, cheapest first, and restarts from the singles after any progress.
+ * Each stage measures its calls, yield (colors validated or pairs merged) and time, and counts the colors
+ * validated and merged, the candidate nodes eliminated and the vertices visited by the graph searches.
+ * The counters are increments and two clock reads by stage run, cheap enough to stay always on.
+ * Hardware counters (perf.h) are added when a PerfCounters is set, one group read before and after each run.
+ * Adaptive scheduling : a stage without yield in its last kStageMissesToDefer runs, and with a yield by ns
+ * below the one of the next stage, is deferred : it is only run when all the other stages are stalled,
+ * so the fixed point reached is the same.
+ * Limits : a deadline and a budget of vertices visited, checked every few colors validated by the singles, after
+ * each round of pairs and by the cycle and level 2 searches between two roots or two probes. Once expired grid_solve
+ * returns : the grid is valid, only less solved, the colors left in the queue are validated by the next grid_solve.
+ * Steps : grid_next_step runs the stages in cost order and returns after the first one with a yield, the nodes it
+ * validated and eliminated logged in a GridStep, for a hint. A stage without yield is not run again by grid_next_step
+ * until the grid changes. The colors enqueued before, the clues or an assumption, are given : flushed first, not logged.
+ * Saved state : grid_save writes the state of a solve in a blob, grid_load restores it in a grid of the same build,
+ * on this machine or another one, and grid_solve goes on from there as if never stopped : the stages already run
+ * without yield are skipped, the cycle and level 2 searches stopped by the limits go on from the root and probe
+ * they stopped at. The blob starts with
+ * kSaveMagic, kSaveVersion, D and the flags of the build, then unsigned LEB128 varints, zigzag encoded for the colors.
+ * The rules as adjacency list (true_to_false_colors) are rebuilt on first use and are not saved.
  */
 
+// saved state header
+enum {
+    kSaveMagic0 = 'r',
+    kSaveMagic1 = 'S',
+    kSaveMagic2 = 'g',
+    kSaveVersion = 2,
+    kSaveHeaderSize = 6, // magic, version, D, flags
+    kSaveFlagCheck = 1 // built with CHECK_GRID, the constraint counts follow the counters
+};
+
+// grid_solve stages, in cost order
+enum {
+    kStageSingle = 0, // grid_validate_check_single, always enabled
+    kStagePair = 1, // grid_merge_check_pair
+    kStagePair1 = 2, // grid_validate_check_pair_1
+    kStagePair2 = 3, // grid_validate_check_pair_2
+    kStageSCC = 4, // grid_merge_check_SCC
+    kStageCycle = 5, // grid_validate_check_cycle
+    kStageLevel2 = 6, // grid_validate_check_cycle_level_2
+    kStageCount = 7,
+    kStageAll = (1 << kStageCount) - 1,
+    kStageMissesToDefer = 2
+};
+
+typedef struct
+{
+    long calls; // runs
+    long yield; // colors validated or pairs merged, as returned by the stage
+    long validated; // colors validated
+    long merged; // colors merged into another one
+    long eliminated; // candidate nodes removed
+    long vertices; // vertices visited by the SCC and cycle searches
+    long ns; // time spent
+    long perf[kPerfCount]; // hardware counters, 0 if not set
+    long deferred; // runs skipped by the adaptive scheduling
+    int misses; // consecutive runs without yield
+} StageStats;
+
+// deadline and operation budget of a solve, shared by a grid and the grids copied from it
+typedef struct
+{
+    int64_t deadline_ns; // monotonic time (timing.h) grid_solve stops at, 0 for none
+    long op_budget; // max vertices visited by the SCC and cycle searches, 0 for no limit
+    long op_cnt; // vertices visited so far
+    int expired; // the deadline or the budget passed, grid_solve returns early until reset
+} GridLimits;
+
+// a step of grid_next_step
+typedef struct
+{
+    int stage; // stage with the first yield, NA if none : the grid is solved, at its fixed point or its limits expired
+    int yield; // as returned by the stage
+    IntVec validated; // nodes validated by the step, each one is cell * N + symbol index
+    IntVec eliminated; // candidate nodes removed by the step, same
+} GridStep;
+
 typedef struct
 {
 #ifdef CHECK_GRID
@@ -45,14 +129,55 @@ typedef struct
 #endif
     NodeId validated_nodes[NN]; // the nodes validated already at their index as in the solution string
     int validated_size; // the number of nodes validated
+    int invalid; // a contradiction was found, the stages do nothing anymore, kept by grid_copy
     ColorVecMap color_to_nodes; // which nodes are of a given color
     ColorVecMap color_to_exclusion_idx; // in which rules a color appears
     IntVec *color_exclusions; // NN * kUnitCount rules, always one and only one color true by rule
     IntVec to_validate; // colors to validate
     IntVec to_merge; // consecutive pair of colors to merge
     ColorVecMap true_to_false_colors; // rules as adjacency list : if color/key true, colors/values false
+    int true_to_false_stale; // true_to_false_colors to rebuild before use
+    unsigned stage_mask; // stages enabled, bit 1 << stage
+    int adaptive; // defer the stages without yield lately
+    StageStats stage_stats[kStageCount]; // since populate
+    long validated_cnt, merged_cnt, eliminated_cnt, vertex_cnt; // running counters for the stage stats
+    const PerfCounters *perf; // if not NULL, read around each stage, kept by grid_copy
+    GridLimits *limits; // if not NULL, checked by grid_solve and inside the cycle and level 2 searches, kept by grid_copy
+    long limit_vertex_cnt; // vertex_cnt already counted in limits->op_cnt
+    unsigned stalled_stages; // stages run to their end without yield since the last change, skipped until one
+    // where the limits stopped the cycle and level 2 searches, the next run starts there, 0 for the first color
+    Color cycle_cursor; // root
+    Color level2_cursor[2]; // root and probe
+    GridStep *step; // if not NULL, the nodes validated and eliminated are logged there, set by grid_next_step only
+    // scratch of the SCC and cycle searches, kept between calls so that they do not allocate, not copied
+    IntVec excl_color_cnt_base, excl_color_cnt, excl_color_cnt_bak; // colors left by rule
+    IntVec scc_stack_color, scc_stack_polarity; // Tarjan stack
 } Grid;
 
+// symbol index of a grid string character, NA for an empty cell
+// D = 3 : [1-9], D >= 4 : [0-9] then [A-Z] or [a-z], ie [0-9A-F] for 16x16 and [0-9A-O] for 25x25
+inline int grid_char_to_int(const char c)
+{
+    int n = NA;
+    if (D == 3) {
+        n = (c >= '1' && c <= '9') ? c - '1' : NA;
+    } else {
+        n = (c >= '0' && c <= '9') ? c - '0' :
+            ((c >= 'A' && c <= 'Z') ? c - 'A' + 10 :
+            ((c >= 'a' && c <= 'z') ? c - 'a' + 10 : NA));
+    }
+    return n < N ? n : NA;
+}
+
+// grid string character of a symbol index
+inline char int_to_grid_char(const int n)
+{
+    if (D == 3) {
+        return n + '1';
+    }
+    return n < 10 ? '0' + n : 'A' - 10 + n;
+}
+
 // init, necessary to initialize storage to sane values
 // return NA if alloc fails
 int  grid_init(Grid *grid);
@@ -61,22 +186,78 @@ void grid_free(Grid *grid);
 // copy from src to dst, src and dst must be initialized, alloc if necessary
 // return NA if alloc fails
 int  grid_copy(const Grid *src, Grid *dst);
+// bytes held by a grid : the struct, the rules and the storage of its containers
+long grid_mem_bytes(const Grid *grid);
 // init the data for an empty grid
 // return NA if alloc fails
 int  grid_init_data(Grid *grid);
+// check a grid string before populating
+// return NA if string is not of the expected lenght, and for a 9x9 sudoku if the number of clues is < 17
+// else return the number of clues
+int  grid_check_str(const char *grid_str);
 // populate a grid from a grid string
-// return NA if alloc fails, if string is not of the expected lenght, and for a 9x9 sudoku if
-// the number of clues is < 17
+// return NA if alloc fails, if string is not of the expected lenght, for a 9x9 sudoku if
+// the number of clues is < 17, and if two clues are in conflict, then invalid is set
 int  grid_populate(Grid *grid, const char *grid_str);
+// set a candidate node as true, it is validated by the next grid_solve
+// return NA if alloc fails or if the node is not a candidate anymore
+// else return 1 if a color was enqueued, 0 if the node was already validated
+int  grid_assume_node(Grid *grid, NodeId node_id);
 // 9 x 9 sudoku grid as a string of 81 characters, any character not [1-9] is considered as an empty cell
 // if compiled with D = 4 in consts.h => 16 x 16 sudoku, any character not [0-9], [a-f] or [A-F] is considered as an empty cell
+// if compiled with D = 5 in consts.h => 25 x 25 sudoku, any character not [0-9], [a-o] or [A-O] is considered as an empty cell
 // return NA if an alloc error occurs, and if CHECK_GRID is defined, if the grid is not valid
 // else return the number of nodes validated, a solved grid returns NN
+// with limits set, stops early once they expire, see grid_limits_expired
+// without CHECK_GRID, stops early once invalid is set : a cell with two symbols, a rule left without color
+// or a color merged with its reverse, checked in constant time. The other contradictions are not seen
 int  grid_solve(Grid *grid);
+// run the stages enabled in cost order until one has a yield, skip the ones stalled since the last change
+// return NA as grid_solve, else 1 if a stage made a step, 0 if none, see GridStep
+int  grid_next_step(Grid *grid, GridStep *step);
+void grid_step_init(GridStep *step);
+void grid_step_free(GridStep *step);
+// first round of grid_solve only : validate the single colors and merge the pairs until nothing changes
+// return NA as grid_solve, else the number of nodes validated, grid_solve can be called after
+int  grid_solve_pairs(Grid *grid);
+// enable the stages in mask, kStageSingle is always enabled, kept by grid_copy
+void grid_set_stages(Grid *grid, unsigned stage_mask, int adaptive);
+// read the hardware counters around each stage, perf may be NULL, kept by grid_copy
+void grid_set_perf(Grid *grid, const PerfCounters *perf);
+// stop grid_solve at a deadline or an operation budget, limits may be NULL, kept by grid_copy
+void grid_set_limits(Grid *grid, GridLimits *limits);
+// start a solve with a deadline (0 for none) and a budget (0 for no limit)
+void grid_limits_reset(GridLimits *limits, int64_t deadline_ns, long op_budget);
+// check the limits of a grid, set expired if passed
+// return 1 if expired : grid_solve returned or returns early, the grid is valid but not at its fixed point
+int  grid_limits_expired(Grid *grid);
+// name of a stage, for logs and command line
+const char *grid_stage_name(int stage);
+// return the stage with that name or NA
+int  grid_stage_from_name(const char *name);
+// add the stats of src minus the ones of base to dst, stage by stage, base may be NULL
+// misses are not summed, for the stats of a grid copied from base and solved
+void grid_stats_add(StageStats dst[kStageCount], const StageStats src[kStageCount], const StageStats base[kStageCount]);
+// write the stats as a JSON object with one member by stage
+void grid_stats_print_json(FILE *f, const StageStats stats[kStageCount]);
+// number of colors holding nodes not validated yet
+int  grid_color_count(Grid *grid);
 // put the validated node in str, use '.' for the positions not solved
 void grid_get_grid_str(Grid *grid, char str[NN + 1]);
 // use N character by grid position, if a validated or a candidate node exists use same convention as input grid string
 // if the candidate don't exist, use '.'
 void grid_get_cands_str(Grid *grid, char str[NN * N + 1]);
+// pack a grid string in kPackedSize bytes, return NA if the string is not of the expected length
+int  grid_pack_str(const char *grid_str, uint8_t packed[kPackedSize]);
+// unpack to a grid string, empty cells as '.', return NA if a cell value is out of range
+int  grid_unpack_str(const uint8_t packed[kPackedSize], char str[NN + 1]);
+// write the state of a grid in blob if size is large enough, call with size 0 to get the size needed
+// the perf counters and the limits set are not part of the state
+// return the size of the state
+long grid_save(const Grid *grid, uint8_t *blob, long size);
+// restore a state written by grid_save, grid must be initialized, its perf counters and limits are kept
+// return NA if alloc fails, if blob is not a state of this version or of this D, or if a value is out of range,
+// then the grid is to be populated or loaded again
+int  grid_load(Grid *grid, const uint8_t *blob, long size);
 
 #endif // GRID_H
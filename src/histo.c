@@ -0,0 +1,115 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "histo.h"
+
+#include <string.h>
+
+static int histo_log2(uint64_t value)
+{
+#ifdef __GNUC__
+    return 63 - __builtin_clzll(value);
+#else
+    int e = 0;
+    while (value >>= 1) {
+        e++;
+    }
+    return e;
+#endif
+}
+
+static int histo_bucket(uint64_t value)
+{
+    if (value < kHistoSubCount) {
+        return (int)value;
+    }
+    int e = histo_log2(value);
+    int sub = (int)(value >> (e - kHistoSubBits)) & (kHistoSubCount - 1);
+    return (e - kHistoSubBits + 1) * kHistoSubCount + sub;
+}
+
+// largest value of a bucket
+static uint64_t histo_bucket_upper(int bucket)
+{
+    if (bucket < kHistoSubCount) {
+        return bucket;
+    }
+    int e = bucket / kHistoSubCount + kHistoSubBits - 1;
+    uint64_t sub = bucket % kHistoSubCount;
+    uint64_t low = (kHistoSubCount + sub) << (e - kHistoSubBits);
+    return low + ((uint64_t)1 << (e - kHistoSubBits)) - 1;
+}
+
+void histo_clear(Histo *histo)
+{
+    memset(histo, 0x00, sizeof(Histo));
+    histo->min = UINT64_MAX;
+}
+
+void histo_record(Histo *histo, uint64_t value)
+{
+    histo->buckets[histo_bucket(value)]++;
+    histo->count++;
+    histo->sum += value;
+    if (value < histo->min) {
+        histo->min = value;
+    }
+    if (value > histo->max) {
+        histo->max = value;
+    }
+}
+
+void histo_merge(Histo *dst, const Histo *src)
+{
+    for (int i = 0; i < kHistoBucketCount; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+uint64_t histo_percentile(const Histo *histo, double p)
+{
+    if (histo->count == 0) {
+        return 0;
+    }
+    // rank of the value, 1 based
+    uint64_t rank = (uint64_t)(p / 100. * histo->count + 0.5);
+    rank = (rank == 0 ? 1 : (rank > histo->count ? histo->count : rank));
+    uint64_t seen = 0;
+    for (int i = 0; i < kHistoBucketCount; i++) {
+        seen += histo->buckets[i];
+        if (seen >= rank) {
+            uint64_t upper = histo_bucket_upper(i);
+            return upper < histo->max ? upper : histo->max;
+        }
+    }
+    return histo->max;
+}
+
+double histo_mean(const Histo *histo)
+{
+    return histo->count ? (double)histo->sum / histo->count : 0.;
+}
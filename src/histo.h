@@ -0,0 +1,56 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HISTO_H
+#define HISTO_H
+
+#include <stdint.h>
+
+/*
+ * Summary:
+ *
+ * Latency histogram, log-linear buckets : each power of 2 is split in 2^kHistoSubBits linear buckets,
+ * so a percentile is known within 1 / 2^kHistoSubBits (about 6%) whatever the range, in constant memory.
+ * Values below 2^kHistoSubBits have a bucket each. min, max and the sum are exact.
+ */
+
+enum {
+    kHistoSubBits = 4,
+    kHistoSubCount = 1 << kHistoSubBits,
+    kHistoBucketCount = (64 - kHistoSubBits + 1) * kHistoSubCount
+};
+
+typedef struct
+{
+    uint64_t buckets[kHistoBucketCount];
+    uint64_t count, sum, min, max;
+} Histo;
+
+// empty the histogram
+void     histo_clear(Histo *histo);
+// add one value
+void     histo_record(Histo *histo, uint64_t value);
+// add the values of src to dst
+void     histo_merge(Histo *dst, const Histo *src);
+// value at percentile p in [0, 100], the upper bound of its bucket capped by max, 0 if empty
+uint64_t histo_percentile(const Histo *histo, double p);
+// mean of the values, 0 if empty
+double   histo_mean(const Histo *histo);
+
+#endif // HISTO_H
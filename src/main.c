@@ -20,17 +20,34 @@
 /*
  * Compilation :
  *
- *  cc -std=c99 -DNDEBUG -Wall -Wextra -Werror -O2 -I. main.c grid.c customtypes.c -o ./rSudokuSolver
+ *  cc -std=c99 -DNDEBUG -Wall -Wextra -Werror -O2 -I. main.c histo.c solver.c grid.c bitgrid.c bitbatch.c search.c dlx.c perf.c customtypes.c canon.c cache.c -pthread -o ./rSudokuSolver
  *
  * for options adjust in consts.h, or define at compile time :
  * verbose : -DDO_PRINT_INFO=1
  * check grid validity while solving : -DCHECK_GRID
+ * count the allocations and report the memory used by grid and by run : -DMEM_STATS
  * for solving 16x16 sudoku : -DD=4
+ * for solving 25x25 sudoku : -DD=5
  *
  * Usage :
  *
  * cat grids.txt | ./rSudokuSolver
  * echo 000540002000001000100009006904000100020800059000100204005400080008020007090008000 | ./rSudokuSolver
+ * cat ../grids/25x25Grids.txt | ./rSudokuSolver # compiled with -DD=5
+ * cat grids.txt | ./rSudokuSolver --search --search-limit 10000
+ * cat grids.txt | ./rSudokuSolver --count
+ * cat grids.txt | ./rSudokuSolver --engine dlx
+ * cat grids.txt | ./rSudokuSolver --route hard=dlx --log-route
+ * cat grids.txt | ./rSudokuSolver --adaptive --stages single,pair,pair1,pair2,cycle,level2
+ * cat grids.txt | ./rSudokuSolver --stats-json stats.json
+ * cat grids.txt | ./rSudokuSolver --perf --stats-json stats.json
+ * cat grids.txt | ./rSudokuSolver --workers 4
+ * cat grids.txt | ./rSudokuSolver --deadline 2000
+ * cat grids.txt | ./rSudokuSolver --deadline 2000 --park parked.bin && ./rSudokuSolver --resume parked.bin
+ * cat grids.txt | ./rSudokuSolver --cache 10000
+ * cat easyGrids.txt | ./rSudokuSolver --batch
+ * ./rSudokuSolver --shard 0/2 out.0 < grids.txt & ./rSudokuSolver --shard 1/2 out.1 < grids.txt; wait
+ * ./rSudokuSolver merge out.0 out.1
  *
  */
 
@@ -61,70 +78,1011 @@
  *                                   if both leads to contradiction it means B and -B => A false, A is always false.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
-#include "grid.h"
+#include "histo.h"
+#include "solver.h"
+#include "timing.h"
 
-int main(int argc, char *argv[])
+enum {
+    kMaxWorkers = 64,
+    kRingSize = 32, // grids by worker between the reader and the writer
+    kShardStatsVersion = 1,
+    kMaxPath = 4096
+};
+
+// the grid strings of stdin, all of them or the ones of a shard
+typedef struct
 {
-    (void)argc, (void)argv;
+    char scan_fmt[16];
+    long pos; // offset in stdin
+    long end; // shard only : the grids from there are the ones of the next shard, NA for no limit
+} Input;
 
-    clock_t start = clock();
+// a grid through the driver
+typedef struct
+{
+    char grid_str[NN * N + 1];
+    char solution_str[NN + 1];
+    SolveResult result;
+    int ret; // of solver_solve
+#ifdef MEM_STATS
+    long peak_bytes; // high-water mark of the IntVec bytes of the solving thread during the solve
+#endif
+} Job;
 
-    char grid_str[NN * N + 1] = "";
+// output by grid and totals of the run, used by one thread only
+typedef struct
+{
+    const SolverOpts *opts;
+    Input *input; // read by the reader thread with --workers
+    FILE *grid_file; // output of the grids, stderr or the shard output
+    int route_log;
+    int perf; // perf counters enabled
+    FILE *stats_file;
+    int grid_cnt, solved_grid_cnt;
+    // count mode : grids without solution, with one solution, with count_limit solutions or more
+    int no_solution_cnt, unique_cnt, several_cnt;
+    int timed_out_cnt; // grids stopped by the deadline or the op budget
+    FILE *park_file; // if not NULL, the state of the grids timed out is written there, see park_write
+    FILE *resume_file; // if not NULL, the grids are the states read there instead of the grid strings
+    int parked_cnt;
+    long cache_lookups, cache_hits, canon_ns; // of the grids looked up in the result cache
+    Histo latency; // ns by grid
+    StageStats stages[kStageCount];
+    long ns, branches;
+#ifdef MEM_STATS
+    MemStats mem; // of the solving threads, solver_init included
+    long peak_bytes[kMaxWorkers]; // high-water marks of the IntVec bytes by solving thread
+    long peak_rss;
+#endif
+} Output;
 
-    Grid base_grid;
-    if (grid_init(&base_grid) == NA) {
-        return EXIT_FAILURE;
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage : %s [options] < grids.txt\n"
+            " --engine e          engine for the grids the singles do not solve : color, color+search or dlx\n"
+            " --route class=e     engine for a difficulty class : medium or hard, default medium=color hard=color+search\n"
+            " --route-threshold n colors left after the first round above which a grid is hard, default %d\n"
+            " --log-route         print the routing decision of each grid\n"
+            " --search            finish with a backtracking search the grids the solver can not\n"
+            " --search-limit n    max number of branches by grid for the search or dlx, 0 for no limit\n"
+            " --count             print the number of solutions instead of a solution, stop at the count limit\n"
+            " --count-limit n     count limit, default 2 : 0, 1 or 2 meaning at least 2 solutions\n"
+            " --stages list       grid_solve stages enabled, comma separated, default all :\n"
+            "                     single,pair,pair1,pair2,scc,cycle,level2, single is always enabled\n"
+            " --adaptive          defer the grid_solve stages without yield lately\n"
+            " --perf              hardware counters by grid_solve stage, IPC and misses by grid, Linux only\n"
+            " --stats-json file   write the counters of the grid_solve stages as JSON, one line by grid then one for the run\n"
+            " --workers n         read, solve with n threads and print in a pipeline, same output, default 0 : one thread\n"
+            " --deadline us       time by grid, then the grid is left as solved so far, 0 for no limit\n"
+            " --op-budget n       vertices visited by the grid_solve searches by grid, same, 0 for no limit\n"
+            " --park file         write the state of the grids timed out with the color solver to file, sequential only\n"
+            " --resume file       go on with the grids parked in file instead of reading grids, sequential only\n"
+            " --cache n           keep the results of n grids by canonical form, reused for the isomorphic grids,\n"
+            "                     by worker with --workers, default 0 : no cache\n"
+            " --batch             singles of %d grids at once, then the grids left one by one, same output, sequential only\n"
+            " --shard i/n out     solve only the lines starting in the byte range i of n of the input, a file,\n"
+            "                     write their output to out and the totals to out.stats, see merge\n"
+            " merge out.0 ..      as first argument : print the outputs of the shards in order and their totals\n",
+            name, 2 * NN, kBatchLanes);
+}
+
+// hardware counters of all the stages of a grid
+static void print_perf(FILE *f, const StageStats stages[kStageCount])
+{
+    long perf[kPerfCount] = { 0 };
+    for (int stage = 0; stage < kStageCount; stage++) {
+        for (int i = 0; i < kPerfCount; i++) {
+            perf[i] += stages[stage].perf[i];
+        }
     }
-    // init one time here, then copy before populating the active grid
-    if (grid_init_data(&base_grid) == NA) {
-        return EXIT_FAILURE;
+    fprintf(f, "perf cycles %ld instructions %ld ipc %.2f llc_misses %ld branch_misses %ld\n",
+            perf[kPerfCycles], perf[kPerfInstructions],
+            perf[kPerfCycles] ? (double)perf[kPerfInstructions] / perf[kPerfCycles] : 0.,
+            perf[kPerfLLCMisses], perf[kPerfBranchMisses]);
+}
+
+// comma separated stage names
+static int parse_stages(const char *arg, SolverOpts *opts)
+{
+    unsigned mask = 0;
+    char name[32];
+    while (*arg) {
+        size_t len = strcspn(arg, ",");
+        if (len == 0 || len >= sizeof(name)) {
+            return NA;
+        }
+        memcpy(name, arg, len);
+        name[len] = '\0';
+        int stage = grid_stage_from_name(name);
+        if (stage == NA) {
+            return NA;
+        }
+        mask |= 1u << stage;
+        arg += len + (arg[len] == ',');
     }
+    opts->stage_mask = mask;
+    return 0;
+}
 
-    Grid grid;
-    if (grid_init(&grid) == NA) {
-        return EXIT_FAILURE;
+// class=engine, only the medium and hard classes are routed
+static int parse_route(const char *arg, SolverOpts *opts)
+{
+    char name[32];
+    const char *eq = strchr(arg, '=');
+    if (!eq || eq - arg >= (long)sizeof(name)) {
+        return NA;
+    }
+    memcpy(name, arg, eq - arg);
+    name[eq - arg] = '\0';
+    int difficulty = solver_class_from_name(name);
+    int engine = solver_engine_from_name(eq + 1);
+    if ((difficulty != kClassMedium && difficulty != kClassHard) || engine == NA || engine == kEngineSingles) {
+        return NA;
+    }
+    opts->routes[difficulty] = engine;
+    return 0;
+}
+
+static void input_init(Input *in)
+{
+    snprintf(in->scan_fmt, sizeof(in->scan_fmt), "%%%ds%%n", NN * N);
+    in->pos = 0;
+    in->end = NA;
+}
+
+// offset of the first line of stdin starting at offset or after, the end of stdin if none
+static long input_line_start(long offset)
+{
+    if (offset == 0 || fseek(stdin, offset - 1, SEEK_SET) != 0) {
+        return offset;
     }
+    int c;
+    while ((c = getchar()) != EOF && c != '\n') {
+        offset++;
+    }
+    return offset;
+}
+
+// read only the grids of the lines starting in the byte range shard of shard_cnt of stdin : each line of the file
+// belongs to one shard, without splitting the file before
+// return NA if stdin is not a file
+static int input_set_shard(Input *in, int shard, int shard_cnt)
+{
+    if (fseek(stdin, 0, SEEK_END) != 0) {
+        return NA;
+    }
+    const long size = ftell(stdin);
+    if (size < 0) {
+        return NA;
+    }
+    const long start = input_line_start(size / shard_cnt * shard + size % shard_cnt * shard / shard_cnt);
+    in->end = input_line_start(size / shard_cnt * (shard + 1) + size % shard_cnt * (shard + 1) / shard_cnt);
+    in->pos = start;
+    return fseek(stdin, start, SEEK_SET);
+}
 
-    int grid_cnt = 0, solved_grid_cnt = 0;
+// read the next grid string, at most NN * N characters
+// return 1 if read, 0 at the end of the input or of the shard
+static int input_read(Input *in, char grid_str[NN * N + 1])
+{
+    int c;
+    while ((c = getchar()) != EOF && isspace(c)) {
+        in->pos++;
+    }
+    if (c == EOF || (in->end != NA && in->pos >= in->end)) {
+        return 0;
+    }
+    ungetc(c, stdin);
+    int size = 0;
+    if (scanf(in->scan_fmt, grid_str, &size) != 1) {
+        return 0;
+    }
+    in->pos += size;
+    return 1;
+}
+
+static void solve_job(Solver *solver, Job *job)
+{
+    job->ret = solver_solve(solver, job->grid_str, job->solution_str, &job->result);
+#ifdef MEM_STATS
+    job->peak_bytes = mem_stats.live_bytes - job->result.mem.live_bytes + job->result.mem.peak_bytes;
+#endif
+}
 
-    while (scanf(" %729s", grid_str) == 1)
-    {
-        if (grid_copy(&base_grid, &grid) == NA) {
+// print a solved grid and add it to the run, worker is the index of the thread that solved it
+static void output_grid(Output *out, int worker, const Job *job)
+{
+    const SolveResult *result = &job->result;
+    if (result->status == kSolveMalformed) {
+        return;
+    }
+    (void)worker;
+
+    out->grid_cnt++;
+
+    if (out->route_log) {
+        solver_print_route(out->grid_file, result);
+    }
+    fprintf(out->grid_file, "%s\n", job->grid_str);
+
+    if (out->opts->count_mode) {
+        fprintf(out->grid_file, "%d%s solution(s)\n", result->solution_cnt,
+                (result->solution_cnt == out->opts->count_limit && out->opts->count_limit > 1) || result->lower_bound ? "+" : "");
+        out->no_solution_cnt += (result->solution_cnt == 0 && !result->lower_bound);
+        out->unique_cnt += (result->solution_cnt == 1 && !result->lower_bound);
+        out->several_cnt += (result->solution_cnt > 1);
+    } else {
+        fprintf(out->grid_file, "%s\n", job->solution_str);
+    }
+    if (out->perf) {
+        print_perf(out->grid_file, result->stages);
+    }
+#ifdef MEM_STATS
+    fprintf(out->grid_file, "mem allocs %ld bytes %ld peak %ld grids %ld rss %ld\n", result->mem.alloc_cnt,
+            result->mem.alloc_bytes, result->mem.peak_bytes, result->grid_bytes, result->rss_bytes);
+    out->peak_bytes[worker] = (job->peak_bytes > out->peak_bytes[worker] ? job->peak_bytes : out->peak_bytes[worker]);
+    out->peak_rss = (result->rss_bytes > out->peak_rss ? result->rss_bytes : out->peak_rss);
+#endif
+    fprintf(out->grid_file, "\n");
+
+    out->solved_grid_cnt += (result->status == kSolveSolved);
+    out->timed_out_cnt += result->timed_out;
+    histo_record(&out->latency, result->ns);
+    if (result->cache != NA) {
+        out->cache_lookups++;
+        out->cache_hits += result->cache;
+        out->canon_ns += result->canon_ns;
+    }
+
+    if (out->stats_file) {
+        fprintf(out->stats_file, "{\"grid\":%d,\"class\":\"%s\",\"engine\":\"%s\",\"status\":%d,\"timed_out\":%d,"
+                "\"ns\":%ld,\"branches\":%ld,\"stages\":",
+                out->grid_cnt, solver_class_name(result->difficulty), solver_engine_name(result->engine), result->status,
+                result->timed_out, result->ns, result->branches);
+        grid_stats_print_json(out->stats_file, result->stages);
+        if (out->opts->cache_size > 0) {
+            fprintf(out->stats_file, ",\"cache\":%d", result->cache);
+        }
+#ifdef MEM_STATS
+        fprintf(out->stats_file, ",\"mem\":{\"allocs\":%ld,\"bytes\":%ld,\"peak\":%ld,\"grids\":%ld,\"rss\":%ld}",
+                result->mem.alloc_cnt, result->mem.alloc_bytes, result->mem.peak_bytes, result->grid_bytes,
+                result->rss_bytes);
+#endif
+        fprintf(out->stats_file, "}\n");
+        grid_stats_add(out->stages, result->stages, NULL);
+        out->ns += result->ns;
+        out->branches += result->branches;
+    }
+}
+
+/*
+ * Parked grid : the size of the state on 4 bytes big endian, the grid string, then the state written by solver_save.
+ */
+
+// return NA if the write fails
+static int park_write(FILE *f, const char *grid_str, const uint8_t *blob, long size)
+{
+    const uint8_t head[4] = { size >> 24, size >> 16, size >> 8, size };
+    if (fwrite(head, 1, 4, f) != 4 || fwrite(grid_str, 1, NN, f) != NN || fwrite(blob, 1, size, f) != (size_t)size) {
+        return NA;
+    }
+    return 0;
+}
+
+// read a parked grid, blob grows to its size
+// return NA on a truncated record or if alloc fails, 0 at the end of the file, else 1
+static int park_read(FILE *f, char grid_str[NN + 1], uint8_t **blob, long *capacity, long *size)
+{
+    uint8_t head[4];
+    const size_t head_size = fread(head, 1, 4, f);
+    if (head_size == 0 && feof(f)) {
+        return 0;
+    }
+    if (head_size != 4 || fread(grid_str, 1, NN, f) != NN) {
+        return NA;
+    }
+    grid_str[NN] = '\0';
+    *size = (long)head[0] << 24 | (long)head[1] << 16 | (long)head[2] << 8 | head[3];
+    if (*size > *capacity) {
+        uint8_t *grown = realloc(*blob, *size);
+        if (!grown) {
+            return NA;
+        }
+        *blob = grown;
+        *capacity = *size;
+    }
+    return fread(*blob, 1, *size, f) == (size_t)*size ? 1 : NA;
+}
+
+// park the grid just solved if it timed out with the color solver
+// return NA if alloc or the write fails
+static int park_job(Output *out, const Solver *solver, const Job *job, uint8_t **blob, long *capacity)
+{
+    if (job->result.status == kSolveSolved || !job->result.timed_out) {
+        return 0;
+    }
+    long size = solver_save(solver, *blob, *capacity);
+    if (size == NA) {
+        return 0;
+    }
+    if (size > *capacity) {
+        uint8_t *grown = realloc(*blob, size);
+        if (!grown) {
+            return NA;
+        }
+        *blob = grown;
+        *capacity = size;
+        solver_save(solver, *blob, *capacity);
+    }
+    GUARD(park_write(out->park_file, job->grid_str, *blob, size));
+    out->parked_cnt++;
+    return 0;
+}
+
+// read, solve and print one grid after the other
+// return NA if solver_init fails, if a parked grid can not be read or written
+static int run_sequential(Output *out)
+{
+    // the Solver struct is large, keep it off the stack
+    static Solver solver;
+    static Job job;
+    if (solver_init(&solver, out->opts) == NA) {
+        return NA;
+    }
+    out->perf = solver.perf_enabled;
+    if (out->opts->perf && !out->perf) {
+        fprintf(stderr, "perf counters not available, timings only\n");
+    }
+#ifdef MEM_STATS
+    out->peak_bytes[0] = mem_stats.live_bytes;
+    out->peak_rss = mem_rss_bytes();
+#endif
+    uint8_t *blob = NULL;
+    long capacity = 0, size = 0;
+    int ret = 0;
+    while (1) {
+        if (out->resume_file) {
+            ret = park_read(out->resume_file, job.grid_str, &blob, &capacity, &size);
+            if (ret != 1) {
+                break;
+            }
+            ret = 0;
+            job.ret = solver_resume(&solver, blob, size, job.solution_str, &job.result);
+        } else if (input_read(out->input, job.grid_str)) {
+            solve_job(&solver, &job);
+        } else {
+            break;
+        }
+        if (job.ret == NA) {
+            ret = (out->resume_file ? NA : 0);
+            break;
+        }
+        output_grid(out, 0, &job);
+        if (out->park_file && park_job(out, &solver, &job, &blob, &capacity) == NA) {
+            ret = NA;
             break;
         }
+    }
+#ifdef MEM_STATS
+    out->mem = mem_stats;
+#endif
+    free(blob);
+    solver_free(&solver);
+    return ret;
+}
 
-        if (grid_populate(&grid, grid_str) == NA) {
-            continue;
+// read kBatchLanes grids, solve them with one batch and print them
+// return NA if solver_init fails
+static int run_batch(Output *out)
+{
+    static Solver solver;
+    static Job jobs[kBatchLanes];
+    static char solutions[kBatchLanes][NN + 1];
+    static SolveResult results[kBatchLanes];
+    if (solver_init(&solver, out->opts) == NA) {
+        return NA;
+    }
+    out->perf = solver.perf_enabled;
+    if (out->opts->perf && !out->perf) {
+        fprintf(stderr, "perf counters not available, timings only\n");
+    }
+#ifdef MEM_STATS
+    out->peak_bytes[0] = mem_stats.live_bytes;
+    out->peak_rss = mem_rss_bytes();
+#endif
+    const char *grid_strs[kBatchLanes];
+    int cnt = 0;
+    do {
+        for (cnt = 0; cnt < kBatchLanes && input_read(out->input, jobs[cnt].grid_str); cnt++) {
+            grid_strs[cnt] = jobs[cnt].grid_str;
+        }
+        if (cnt > 0 && solver_solve_batch(&solver, grid_strs, cnt, solutions, results) == NA) {
+            break;
         }
+        for (int i = 0; i < cnt; i++) {
+            memcpy(jobs[i].solution_str, solutions[i], NN + 1);
+            jobs[i].result = results[i];
+#ifdef MEM_STATS
+            jobs[i].peak_bytes = mem_stats.live_bytes - results[i].mem.live_bytes + results[i].mem.peak_bytes;
+#endif
+            output_grid(out, 0, &jobs[i]);
+        }
+    } while (cnt == kBatchLanes);
+#ifdef MEM_STATS
+    out->mem = mem_stats;
+#endif
+    solver_free(&solver);
+    return 0;
+}
+
+#ifdef __GNUC__
+/*
+ * Pipeline : a reader thread parses the grids, worker threads solve them and the main thread prints them,
+ * so the input and the output do not stall the solve. Each worker has a ring of kRingSize jobs and three indexes,
+ * each one moved by one thread only : filled by the reader, solved by the worker, written by the writer.
+ * Grid i goes to the ring i % worker count, the writer reads the rings in the same order : the output is
+ * the one of the sequential driver. No lock : a stage with nothing to do spins, yields then sleeps,
+ * a full ring stops the reader.
+ */
+
+#define LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+// a ring index alone on its cache line
+typedef struct
+{
+    long value;
+    char pad[64 - sizeof(long)];
+} RingIndex;
+
+typedef struct
+{
+    RingIndex filled, solved, written; // jobs[i % kRingSize]
+    int closed; // by the reader, no job after filled
+    int ready; // by the worker, 1 once its solver is ready, NA if solver_init failed
+    Job *jobs;
+    Solver *solver;
+    const SolverOpts *opts;
+    pthread_t thread;
+#ifdef MEM_STATS
+    long init_bytes; // IntVec bytes of the worker after solver_init
+    MemStats mem; // counters of the worker at its end
+#endif
+} Ring;
 
-        grid_cnt++;
+typedef struct
+{
+    Ring *rings;
+    int ring_cnt;
+    int stop; // by the writer after a failed solve, the reader stops
+    Input *input;
+} Pipeline;
+
+// spin, then yield, then sleep : a stage waiting for another one does not take its cpu for long
+static void backoff(int *spins)
+{
+    if (++*spins < 64) {
+        return;
+    }
+    if (*spins < 128) {
+        sched_yield();
+        return;
+    }
+    struct timespec ts = { 0, 50000 };
+    nanosleep(&ts, NULL);
+}
 
-        fprintf(stderr, "%s\n", grid_str);
+// wait for the job index of a ring to be moved past by the stage before
+// return NA once the ring is closed and index is the end
+static int ring_wait(Ring *ring, long index, const long *before)
+{
+    int spins = 0;
+    while (LOAD(before) == index) {
+        if (LOAD(&ring->closed) && LOAD(&ring->filled.value) == index) {
+            return NA;
+        }
+        backoff(&spins);
+    }
+    return 0;
+}
 
-        int validated_size = grid_solve(&grid);
-        if (validated_size == NA) {
+static void *pipeline_read(void *arg)
+{
+    Pipeline *pl = arg;
+    for (long i = 0; !LOAD(&pl->stop); i++) {
+        Ring *ring = &pl->rings[i % pl->ring_cnt];
+        const long filled = ring->filled.value;
+        int spins = 0;
+        while (filled - LOAD(&ring->written.value) == kRingSize) {
+            backoff(&spins);
+        }
+        if (!input_read(pl->input, ring->jobs[filled % kRingSize].grid_str)) {
             break;
         }
+        STORE(&ring->filled.value, filled + 1);
+    }
+    for (int w = 0; w < pl->ring_cnt; w++) {
+        STORE(&pl->rings[w].closed, 1);
+    }
+    return NULL;
+}
 
-        grid_get_grid_str(&grid, grid_str);
-        fprintf(stderr, "%s\n\n", grid_str);
+static void *pipeline_solve(void *arg)
+{
+    Ring *ring = arg;
+    // in this thread : the perf counters count the thread that opens them
+    if (solver_init(ring->solver, ring->opts) == NA) {
+        STORE(&ring->ready, NA);
+        return NULL;
+    }
+#ifdef MEM_STATS
+    ring->init_bytes = mem_stats.live_bytes;
+#endif
+    STORE(&ring->ready, 1);
+    for (long solved = 0; ring_wait(ring, solved, &ring->filled.value) != NA; solved++) {
+        solve_job(ring->solver, &ring->jobs[solved % kRingSize]);
+        STORE(&ring->solved.value, solved + 1);
+    }
+#ifdef MEM_STATS
+    ring->mem = mem_stats;
+#endif
+    solver_free(ring->solver);
+    return NULL;
+}
 
-        solved_grid_cnt += (validated_size == NN);
+static void pipeline_free(Pipeline *pl)
+{
+    for (int w = 0; w < pl->ring_cnt; w++) {
+        free(pl->rings[w].jobs);
+        free(pl->rings[w].solver);
     }
+    free(pl->rings);
+}
 
-    clock_t end = clock();
-    uint64_t us = ((end - start)/(double)CLOCKS_PER_SEC) * 1000000;
+// the pipeline with worker_cnt solving threads, the main thread is the writer
+// return NA if alloc, a thread or solver_init fails
+static int run_pipeline(Output *out, int worker_cnt)
+{
+    Pipeline pl;
+    pl.ring_cnt = worker_cnt;
+    pl.stop = 0;
+    pl.input = out->input;
+    if (!(pl.rings = calloc(worker_cnt, sizeof(Ring)))) {
+        return NA;
+    }
+    int started = 0, result = 0;
+    for (; started < worker_cnt; started++) {
+        Ring *ring = &pl.rings[started];
+        ring->opts = out->opts;
+        ring->jobs = malloc(kRingSize * sizeof(Job));
+        ring->solver = malloc(sizeof(Solver));
+        if (!ring->jobs || !ring->solver || pthread_create(&ring->thread, NULL, pipeline_solve, ring) != 0) {
+            result = NA;
+            break;
+        }
+    }
+    out->perf = 1;
+    for (int w = 0; w < started; w++) {
+        int spins = 0;
+        while (!LOAD(&pl.rings[w].ready)) {
+            backoff(&spins);
+        }
+        if (pl.rings[w].ready == NA) {
+            result = NA;
+        } else {
+            out->perf &= pl.rings[w].solver->perf_enabled;
+#ifdef MEM_STATS
+            out->peak_bytes[w] = pl.rings[w].init_bytes;
+#endif
+        }
+    }
+    pthread_t reader;
+    if (result == NA || pthread_create(&reader, NULL, pipeline_read, &pl) != 0) {
+        // the workers ready find their ring closed and empty
+        for (int w = 0; w < started; w++) {
+            STORE(&pl.rings[w].closed, 1);
+            pthread_join(pl.rings[w].thread, NULL);
+        }
+        pipeline_free(&pl);
+        return NA;
+    }
+    if (out->opts->perf && !out->perf) {
+        fprintf(stderr, "perf counters not available, timings only\n");
+    }
+#ifdef MEM_STATS
+    out->peak_rss = mem_rss_bytes();
+#endif
 
+    for (long i = 0;; i++) {
+        const int w = i % worker_cnt;
+        Ring *ring = &pl.rings[w];
+        const long written = ring->written.value;
+        if (ring_wait(ring, written, &ring->solved.value) == NA) {
+            break;
+        }
+        const Job *job = &ring->jobs[written % kRingSize];
+        // after a failed solve the jobs left are dropped, as the sequential driver stops there
+        if (job->ret == NA) {
+            STORE(&pl.stop, 1);
+        } else if (!pl.stop) {
+            output_grid(out, w, job);
+        }
+        STORE(&ring->written.value, written + 1);
+    }
+
+    pthread_join(reader, NULL);
+    for (int w = 0; w < worker_cnt; w++) {
+        pthread_join(pl.rings[w].thread, NULL);
+#ifdef MEM_STATS
+        out->mem.alloc_cnt += pl.rings[w].mem.alloc_cnt;
+        out->mem.alloc_bytes += pl.rings[w].mem.alloc_bytes;
+#endif
+    }
+    pipeline_free(&pl);
+    return 0;
+}
+#endif // __GNUC__
+
+// the totals of a run or of merged shards, limited if a deadline or an op budget was set
+static void print_totals(const Output *out, int count_mode, int limited)
+{
+    if (count_mode) {
+        fprintf(stderr, "no solution %d unique %d several %d unknown %d\n", out->no_solution_cnt, out->unique_cnt,
+                out->several_cnt, out->grid_cnt - out->no_solution_cnt - out->unique_cnt - out->several_cnt);
+    }
+    if (limited) {
+        fprintf(stderr, "timed out %d\n", out->timed_out_cnt);
+    }
+}
+
+static void print_solved(const Output *out, uint64_t us)
+{
+    const int grid_cnt = out->grid_cnt, solved_grid_cnt = out->solved_grid_cnt;
     fprintf(stderr, "solved %d / %d %3.3f%% time grid % 3.3f us time total %ld us\n",
             solved_grid_cnt, grid_cnt, 100.f * solved_grid_cnt / (grid_cnt == 0 ? 1.f : (float)grid_cnt),
             (float)us / (float)(grid_cnt == 0 ? 1 : grid_cnt), us);
+}
+
+static void print_latency(const Histo *latency)
+{
+    fprintf(stderr, "latency p50 %.1f us p90 %.1f us p99 %.1f us max %.1f us\n",
+            histo_percentile(latency, 50) / 1e3, histo_percentile(latency, 90) / 1e3,
+            histo_percentile(latency, 99) / 1e3, (latency->count ? latency->max : 0) / 1e3);
+}
+
+/*
+ * Shard stats : the totals of a shard for merge, text, the non empty buckets of the latency histogram only.
+ */
+
+static void shard_stats_write(FILE *f, int shard, int shard_cnt, const Output *out, int count_mode, int limited,
+                              uint64_t us)
+{
+    const Histo *h = &out->latency;
+    int bucket_cnt = 0;
+    for (int i = 0; i < kHistoBucketCount; i++) {
+        bucket_cnt += (h->buckets[i] != 0);
+    }
+    fprintf(f, "rsudoku-shard-stats %d %d\nshard %d %d\nflags %d %d\n", kShardStatsVersion, D, shard, shard_cnt,
+            count_mode, limited);
+    fprintf(f, "grids %d %d %d %d %d %d\nus %lu\n", out->grid_cnt, out->solved_grid_cnt, out->no_solution_cnt,
+            out->unique_cnt, out->several_cnt, out->timed_out_cnt, (unsigned long)us);
+    fprintf(f, "latency %lu %lu %lu %lu %d\n", (unsigned long)h->count, (unsigned long)h->sum, (unsigned long)h->min,
+            (unsigned long)h->max, bucket_cnt);
+    for (int i = 0; i < kHistoBucketCount; i++) {
+        if (h->buckets[i] != 0) {
+            fprintf(f, "%d %lu\n", i, (unsigned long)h->buckets[i]);
+        }
+    }
+}
+
+// add the stats of a shard to out
+// return NA if the file is not the stats of shard of shard_cnt of this build
+static int shard_stats_read(FILE *f, int shard, int shard_cnt, Output *out, int *count_mode, int *limited,
+                            uint64_t *us)
+{
+    int version = 0, d = 0, index = NA, cnt = 0, bucket_cnt = 0;
+    int grids[6];
+    unsigned long shard_us, h[4];
+    if (fscanf(f, " rsudoku-shard-stats %d %d shard %d %d flags %d %d", &version, &d, &index, &cnt, count_mode,
+               limited) != 6 || version != kShardStatsVersion || d != D || index != shard || cnt != shard_cnt
+            || fscanf(f, " grids %d %d %d %d %d %d us %lu", &grids[0], &grids[1], &grids[2], &grids[3], &grids[4],
+                      &grids[5], &shard_us) != 7
+            || fscanf(f, " latency %lu %lu %lu %lu %d", &h[0], &h[1], &h[2], &h[3], &bucket_cnt) != 5) {
+        return NA;
+    }
+    Histo latency;
+    histo_clear(&latency);
+    for (int i = 0; i < bucket_cnt; i++) {
+        int bucket;
+        unsigned long value;
+        if (fscanf(f, " %d %lu", &bucket, &value) != 2 || bucket < 0 || bucket >= kHistoBucketCount) {
+            return NA;
+        }
+        latency.buckets[bucket] = value;
+    }
+    latency.count = h[0];
+    latency.sum = h[1];
+    latency.min = (h[0] ? h[2] : UINT64_MAX);
+    latency.max = h[3];
+    histo_merge(&out->latency, &latency);
+    out->grid_cnt += grids[0];
+    out->solved_grid_cnt += grids[1];
+    out->no_solution_cnt += grids[2];
+    out->unique_cnt += grids[3];
+    out->several_cnt += grids[4];
+    out->timed_out_cnt += grids[5];
+    *us += shard_us;
+    return 0;
+}
+
+// merge subcommand : the outputs of the shards in order on stderr, then the totals of all of them, as one run
+static int merge_main(int argc, char *argv[])
+{
+    const int shard_cnt = argc - 2;
+    if (shard_cnt < 1) {
+        fprintf(stderr, "usage : %s merge out.0 .. out.n-1, the outputs of --shard 0/n out.0 .. --shard n-1/n out.n-1\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+    static Output out;
+    histo_clear(&out.latency);
+    int count_mode = 0, limited = 0;
+    uint64_t us = 0;
+    // the stats first : a missing shard fails before any output
+    for (int shard = 0; shard < shard_cnt; shard++) {
+        char stats_path[kMaxPath];
+        FILE *f = NULL;
+        if (snprintf(stats_path, sizeof(stats_path), "%s.stats", argv[shard + 2]) >= (int)sizeof(stats_path)
+                || !(f = fopen(stats_path, "r"))) {
+            perror(argv[shard + 2]);
+            return EXIT_FAILURE;
+        }
+        int shard_count_mode = 0, shard_limited = 0;
+        const int ret = shard_stats_read(f, shard, shard_cnt, &out, &shard_count_mode, &shard_limited, &us);
+        fclose(f);
+        if (ret == NA) {
+            fprintf(stderr, "%s : not the stats of shard %d/%d of this build\n", stats_path, shard, shard_cnt);
+            return EXIT_FAILURE;
+        }
+        count_mode |= shard_count_mode;
+        limited |= shard_limited;
+    }
+    for (int shard = 0; shard < shard_cnt; shard++) {
+        FILE *f = fopen(argv[shard + 2], "rb");
+        if (!f) {
+            perror(argv[shard + 2]);
+            return EXIT_FAILURE;
+        }
+        char buf[1 << 16];
+        size_t size;
+        while ((size = fread(buf, 1, sizeof(buf), f)) > 0) {
+            fwrite(buf, 1, size, stderr);
+        }
+        fclose(f);
+    }
+    print_totals(&out, count_mode, limited);
+    print_solved(&out, us);
+    print_latency(&out.latency);
+    return EXIT_SUCCESS;
+}
 
-    grid_free(&grid);
-    grid_free(&base_grid);
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "merge") == 0) {
+        return merge_main(argc, argv);
+    }
+    SolverOpts opts;
+    solver_default_opts(&opts);
+    int use_search = 0, route_log = 0, worker_cnt = 0, batch = 0;
+    int shard = NA, shard_cnt = 0;
+    const char *stats_path = NULL, *park_path = NULL, *resume_path = NULL, *shard_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            int engine = solver_engine_from_name(argv[++i]);
+            if (engine == NA || engine == kEngineSingles) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            opts.routes[kClassMedium] = opts.routes[kClassHard] = engine;
+        } else if (strcmp(argv[i], "--route") == 0 && i + 1 < argc) {
+            if (parse_route(argv[++i], &opts) == NA) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--route-threshold") == 0 && i + 1 < argc) {
+            opts.color_threshold = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--log-route") == 0) {
+            route_log = 1;
+        } else if (strcmp(argv[i], "--search") == 0) {
+            use_search = 1;
+        } else if (strcmp(argv[i], "--search-limit") == 0 && i + 1 < argc) {
+            opts.search_limit = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--count") == 0) {
+            opts.count_mode = 1;
+        } else if (strcmp(argv[i], "--count-limit") == 0 && i + 1 < argc) {
+            opts.count_limit = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stages") == 0 && i + 1 < argc) {
+            if (parse_stages(argv[++i], &opts) == NA) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            opts.adaptive = 1;
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            opts.perf = 1;
+        } else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc) {
+            stats_path = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            worker_cnt = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--deadline") == 0 && i + 1 < argc) {
+            opts.deadline_us = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--op-budget") == 0 && i + 1 < argc) {
+            opts.op_budget = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--park") == 0 && i + 1 < argc) {
+            park_path = argv[++i];
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = 1;
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            opts.cache_size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc) {
+            resume_path = argv[++i];
+        } else if (strcmp(argv[i], "--shard") == 0 && i + 2 < argc) {
+            if (sscanf(argv[++i], "%d/%d", &shard, &shard_cnt) != 2 || shard < 0 || shard >= shard_cnt) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            shard_path = argv[++i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (opts.count_limit < 1 || worker_cnt < 0 || worker_cnt > kMaxWorkers || opts.deadline_us < 0 || opts.op_budget < 0
+            || opts.cache_size < 0 || ((park_path || resume_path) && (worker_cnt > 0 || batch))
+            || (batch && worker_cnt > 0) || (shard_path && resume_path)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (use_search) {
+        for (int c = kClassMedium; c <= kClassHard; c++) {
+            if (opts.routes[c] == kEngineColor) {
+                opts.routes[c] = kEngineColorSearch;
+            }
+        }
+    }
+
+    // the route is printed with the grid, from the thread printing the grids
+    opts.route_log = NULL;
+
+    static Input input;
+    input_init(&input);
+    if (shard_path && input_set_shard(&input, shard, shard_cnt) == NA) {
+        fprintf(stderr, "--shard reads a file : %s --shard %d/%d %s < grids.txt\n", argv[0], shard, shard_cnt,
+                shard_path);
+        return EXIT_FAILURE;
+    }
+
+    // the Output struct is large, keep it off the stack
+    static Output out;
+    out.opts = &opts;
+    out.input = &input;
+    out.grid_file = stderr;
+    out.route_log = route_log;
+    histo_clear(&out.latency);
+    char shard_stats_path[kMaxPath];
+    FILE *shard_stats = NULL;
+    if (shard_path) {
+        if (!(out.grid_file = fopen(shard_path, "w"))) {
+            perror(shard_path);
+            return EXIT_FAILURE;
+        }
+        if (snprintf(shard_stats_path, sizeof(shard_stats_path), "%s.stats", shard_path) >= (int)sizeof(shard_stats_path)
+                || !(shard_stats = fopen(shard_stats_path, "w"))) {
+            perror(shard_path);
+            return EXIT_FAILURE;
+        }
+    }
+    if (stats_path && !(out.stats_file = fopen(stats_path, "w"))) {
+        perror(stats_path);
+        return EXIT_FAILURE;
+    }
+    if (park_path && !(out.park_file = fopen(park_path, "wb"))) {
+        perror(park_path);
+        return EXIT_FAILURE;
+    }
+    if (resume_path && !(out.resume_file = fopen(resume_path, "rb"))) {
+        perror(resume_path);
+        return EXIT_FAILURE;
+    }
+
+    clock_t start = clock();
+    int64_t start_ns = timing_now_ns();
+
+    int ret;
+#ifdef __GNUC__
+    ret = (worker_cnt == 0 ? (batch ? run_batch(&out) : run_sequential(&out)) : run_pipeline(&out, worker_cnt));
+#else
+    if (worker_cnt > 0) {
+        fprintf(stderr, "--workers not available in this build, sequential\n");
+    }
+    ret = (batch ? run_batch(&out) : run_sequential(&out));
+#endif
+    if (out.resume_file) {
+        fclose(out.resume_file);
+    }
+    if (out.park_file && fclose(out.park_file) != 0) {
+        ret = NA;
+    }
+    if (ret == NA) {
+        if (resume_path) {
+            fprintf(stderr, "%s : a parked grid is truncated or not of this build\n", resume_path);
+        }
+        return EXIT_FAILURE;
+    }
+#ifdef MEM_STATS
+    long run_peak_bytes = 0;
+    for (int w = 0; w < (worker_cnt ? worker_cnt : 1); w++) {
+        run_peak_bytes += out.peak_bytes[w];
+    }
+#endif
+
+    if (out.stats_file) {
+        fprintf(out.stats_file, "{\"run\":{\"grids\":%d,\"solved\":%d,\"timed_out\":%d,\"ns\":%ld,\"branches\":%ld,\"stages\":",
+                out.grid_cnt, out.solved_grid_cnt, out.timed_out_cnt, out.ns, out.branches);
+        grid_stats_print_json(out.stats_file, out.stages);
+        if (opts.cache_size > 0) {
+            fprintf(out.stats_file, ",\"cache\":{\"lookups\":%ld,\"hits\":%ld,\"canon_ns\":%ld}",
+                    out.cache_lookups, out.cache_hits, out.canon_ns);
+        }
+#ifdef MEM_STATS
+        fprintf(out.stats_file, ",\"mem\":{\"allocs\":%ld,\"bytes\":%ld,\"peak\":%ld,\"rss_peak\":%ld}",
+                out.mem.alloc_cnt, out.mem.alloc_bytes, run_peak_bytes, out.peak_rss);
+#endif
+        fprintf(out.stats_file, "}}\n");
+        fclose(out.stats_file);
+    }
+
+    const int limited = (opts.deadline_us != 0 || opts.op_budget != 0);
+    print_totals(&out, opts.count_mode, limited);
+    if (out.park_file) {
+        fprintf(stderr, "parked %d\n", out.parked_cnt);
+    }
+    if (opts.cache_size > 0) {
+        fprintf(stderr, "cache hits %ld / %ld lookups canonical form % 3.3f us by lookup\n", out.cache_hits,
+                out.cache_lookups, out.canon_ns / 1000.f / (out.cache_lookups == 0 ? 1.f : (float)out.cache_lookups));
+    }
+
+    // process time, the wall time with the pipeline : its threads wait for each other
+    clock_t end = clock();
+    uint64_t us = ((end - start)/(double)CLOCKS_PER_SEC) * 1000000;
+    if (worker_cnt > 0) {
+        us = (timing_now_ns() - start_ns) / 1000;
+    }
+
+    print_solved(&out, us);
+    if (shard_path) {
+        print_latency(&out.latency);
+        shard_stats_write(shard_stats, shard, shard_cnt, &out, opts.count_mode, limited, us);
+        if (fclose(shard_stats) != 0 || fclose(out.grid_file) != 0) {
+            perror(shard_path);
+            return EXIT_FAILURE;
+        }
+    }
+#ifdef MEM_STATS
+    // the run includes the allocations of solver_init
+    fprintf(stderr, "mem allocs %ld bytes %ld peak %ld rss peak %ld\n", out.mem.alloc_cnt, out.mem.alloc_bytes,
+            run_peak_bytes, out.peak_rss);
+#endif
 
     return EXIT_SUCCESS;
 }
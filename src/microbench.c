@@ -0,0 +1,428 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmark of the customtypes.h containers, a separate program from the solver.
+ *
+ * Compilation :
+ *
+ *  cc -std=c99 -DNDEBUG -Wall -Wextra -Werror -O2 -I. microbench.c histo.c grid.c perf.c customtypes.c -o ./rSudokuMicrobench
+ *  add -DD=4 or -DD=5 for the 16x16 or 25x25 containers
+ *
+ * Usage :
+ *
+ * ./rSudokuMicrobench # states captured from ../grids/hardGrids.txt, 16x16HardGrids.txt or 25x25HardGrids.txt
+ * ./rSudokuMicrobench --repeat 50 --max-grids 20 ../grids/veryHardGrids.txt
+ *
+ * The containers are not filled with made up sizes : the Grid states grid_solve works on are captured
+ * from real solves of a corpus, stopped before SCC, before cycle and before level 2 (grid_set_stages),
+ * and every operation runs on the vectors and maps of these states :
+ * - ivec_find_first_from : on each rule and each color to rules list, a value present (the last one) and one absent
+ * - ivec_erase_at_idx    : copies of the rules emptied from their middle
+ * - cvmap_insert_one     : color_to_nodes of each state rebuilt in a cleared map
+ * - cvmap_keys           : on fresh copies of color_to_nodes, which drops the erased keys, then again on the clean list
+ * - cvmap_copy           : the 3 maps of each state copied, as grid_copy does
+ * - vmap_clear           : the VertexMap reset done by the cycle searches for each color
+ * Each operation runs repeat times, the best and the median ns by call are kept.
+ * One JSON line by operation on stdout, with the distribution of the container sizes, a table on stderr.
+ */
+
+// clock_gettime
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "grid.h"
+#include "histo.h"
+#include "timing.h"
+
+enum {
+    kMaxStates = 256,
+    kMaxRepeat = 1000,
+    kCaptureCount = 3
+};
+
+// stages enabled for each capture, the state left is the one the next stage works on
+static const unsigned kCaptureMasks[kCaptureCount] = {
+    (1u << kStageSingle) | (1u << kStagePair) | (1u << kStagePair1) | (1u << kStagePair2),
+    (1u << kStageSingle) | (1u << kStagePair) | (1u << kStagePair1) | (1u << kStagePair2) | (1u << kStageSCC),
+    kStageAll & ~(1u << kStageLevel2)
+};
+
+typedef struct
+{
+    Grid *states[kMaxStates];
+    int size;
+} Captured;
+
+typedef struct
+{
+    const char *name;
+    long calls; // by repeat
+    int64_t ns[kMaxRepeat];
+    Histo sizes; // sizes of the containers used
+} OpResult;
+
+// keeps the results alive so the loops are not optimized out
+static volatile long g_sink;
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage : %s [options] [corpus], default corpus the hard grids of ../grids of the size built\n"
+            " --repeat n          runs of each operation, default 20\n"
+            " --max-grids n       grids of the corpus used for the capture, default 40\n",
+            name);
+}
+
+static int capture_push(Captured *cap, const Grid *grid)
+{
+    if (cap->size == kMaxStates || grid->validated_size == NN) {
+        return 0;
+    }
+    Grid *state = malloc(sizeof(Grid));
+    if (!state) {
+        return NA;
+    }
+    if (grid_init(state) == NA) {
+        free(state);
+        return NA;
+    }
+    cap->states[cap->size++] = state;
+    return grid_copy(grid, state);
+}
+
+// return NA if the corpus can not be read or if alloc fails
+static int capture(Captured *cap, const char *path, int max_grids)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return NA;
+    }
+    // the Grid structs are large, keep them off the stack
+    static Grid base_grid, grid;
+    int result = 0;
+    if (grid_init(&base_grid) == NA || grid_init(&grid) == NA || grid_init_data(&base_grid) == NA) {
+        result = NA;
+    }
+    char scan_fmt[16];
+    snprintf(scan_fmt, sizeof(scan_fmt), " %%%ds", NN * N);
+    static char grid_str[NN * N + 1];
+    for (int cnt = 0; result != NA && cnt < max_grids && fscanf(f, scan_fmt, grid_str) == 1;) {
+        if (grid_check_str(grid_str) == NA) {
+            continue;
+        }
+        cnt++;
+        for (int c = 0; c < kCaptureCount && result != NA; c++) {
+            grid_set_stages(&base_grid, kCaptureMasks[c], 0);
+            if (grid_copy(&base_grid, &grid) == NA || grid_populate(&grid, grid_str) == NA
+                    || grid_solve(&grid) == NA) {
+                result = NA;
+                break;
+            }
+            result = capture_push(cap, &grid);
+        }
+    }
+    fclose(f);
+    grid_free(&grid);
+    grid_free(&base_grid);
+    return result;
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void op_report(const OpResult *op, int repeat)
+{
+    int64_t sorted[kMaxRepeat];
+    memcpy(sorted, op->ns, repeat * sizeof(int64_t));
+    qsort(sorted, repeat, sizeof(int64_t), cmp_int64);
+    const double calls = op->calls ? op->calls : 1;
+    const double best = sorted[0] / calls, med = sorted[repeat / 2] / calls;
+    printf("{\"op\":\"%s\",\"d\":%d,\"calls\":%ld,\"repeat\":%d,\"ns_best\":%.2f,\"ns_median\":%.2f,"
+           "\"size\":{\"mean\":%.1f,\"p50\":%lu,\"p90\":%lu,\"max\":%lu}}\n",
+           op->name, D, op->calls, repeat, best, med, histo_mean(&op->sizes),
+           (unsigned long)histo_percentile(&op->sizes, 50), (unsigned long)histo_percentile(&op->sizes, 90),
+           (unsigned long)op->sizes.max);
+    fprintf(stderr, "%-28s %9ld calls  best %9.2f ns  median %9.2f ns  size p50 %4lu p90 %4lu max %4lu\n",
+            op->name, op->calls, best, med, (unsigned long)histo_percentile(&op->sizes, 50),
+            (unsigned long)histo_percentile(&op->sizes, 90), (unsigned long)op->sizes.max);
+}
+
+static void bench_find(const Captured *cap, OpResult *op, int repeat)
+{
+    op->name = "ivec_find_first_from";
+    for (int r = 0; r < repeat; r++) {
+        long sink = 0, calls = 0;
+        const int64_t start = timing_now_ns();
+        for (int s = 0; s < cap->size; s++) {
+            Grid *grid = cap->states[s];
+            for (int idx = 0; idx < kUnitCount * NN; idx++) {
+                const IntVec *rule = &grid->color_exclusions[idx];
+                if (ivec_size(rule) == 0) {
+                    continue;
+                }
+                sink += ivec_find_first_from(rule, 0, ivec_at_idx(rule, ivec_size(rule) - 1));
+                sink += ivec_find_first_from(rule, 0, N * NN + 1);
+                calls += 2;
+            }
+            const IntVec *keys = cvmap_keys(&grid->color_to_exclusion_idx);
+            for (int i = 0, iend = ivec_size(keys); i < iend; i++) {
+                const IntVec *idxs = cvmap_get_IntVec(&grid->color_to_exclusion_idx, ivec_at_idx(keys, i));
+                if (ivec_size(idxs) == 0) {
+                    continue;
+                }
+                sink += ivec_find_first_from(idxs, 0, ivec_at_idx(idxs, ivec_size(idxs) - 1));
+                sink += ivec_find_first_from(idxs, 0, kUnitCount * NN);
+                calls += 2;
+            }
+        }
+        op->ns[r] = timing_now_ns() - start;
+        op->calls = calls;
+        g_sink += sink;
+    }
+    for (int s = 0; s < cap->size; s++) {
+        for (int idx = 0; idx < kUnitCount * NN; idx++) {
+            int size = ivec_size(&cap->states[s]->color_exclusions[idx]);
+            if (size != 0) {
+                histo_record(&op->sizes, size);
+            }
+        }
+    }
+}
+
+// return NA if alloc fails
+static int bench_erase(const Captured *cap, OpResult *op, int repeat)
+{
+    op->name = "ivec_erase_at_idx";
+    const int vec_cnt = cap->size * kUnitCount * NN;
+    IntVec *vecs = malloc(vec_cnt * sizeof(IntVec));
+    if (!vecs) {
+        return NA;
+    }
+    for (int i = 0; i < vec_cnt; i++) {
+        ivec_init(&vecs[i]);
+    }
+    int result = 0;
+    for (int r = 0; r < repeat && result != NA; r++) {
+        for (int s = 0, i = 0; s < cap->size && result != NA; s++) {
+            for (int idx = 0; idx < kUnitCount * NN; idx++, i++) {
+                if (ivec_copy(&cap->states[s]->color_exclusions[idx], &vecs[i]) == NA) {
+                    result = NA;
+                    break;
+                }
+            }
+        }
+        long calls = 0;
+        const int64_t start = timing_now_ns();
+        for (int i = 0; i < vec_cnt; i++) {
+            int size = 0;
+            while ((size = ivec_size(&vecs[i])) != 0) {
+                ivec_erase_at_idx(&vecs[i], size / 2);
+                calls++;
+            }
+        }
+        op->ns[r] = timing_now_ns() - start;
+        op->calls = calls;
+    }
+    for (int i = 0; i < vec_cnt; i++) {
+        ivec_free(&vecs[i]);
+    }
+    free(vecs);
+    for (int s = 0; s < cap->size; s++) {
+        for (int idx = 0; idx < kUnitCount * NN; idx++) {
+            int size = ivec_size(&cap->states[s]->color_exclusions[idx]);
+            if (size != 0) {
+                histo_record(&op->sizes, size);
+            }
+        }
+    }
+    return result;
+}
+
+// return NA if alloc fails
+static int bench_insert(const Captured *cap, ColorVecMap *map, OpResult *op, int repeat)
+{
+    op->name = "cvmap_insert_one";
+    for (int r = 0; r < repeat; r++) {
+        long calls = 0;
+        int64_t ns = 0;
+        for (int s = 0; s < cap->size; s++) {
+            ColorVecMap *src = &cap->states[s]->color_to_nodes;
+            const IntVec *keys = cvmap_keys(src);
+            cvmap_clear(map);
+            const int64_t start = timing_now_ns();
+            for (int i = 0, iend = ivec_size(keys); i < iend; i++) {
+                Color color = ivec_at_idx(keys, i);
+                const IntVec *nodes = cvmap_get_IntVec(src, color);
+                for (int j = 0, jend = ivec_size(nodes); j < jend; j++) {
+                    GUARD(cvmap_insert_one(map, color, ivec_at_idx(nodes, j)));
+                }
+                calls += ivec_size(nodes);
+            }
+            ns += timing_now_ns() - start;
+        }
+        op->ns[r] = ns;
+        op->calls = calls;
+    }
+    for (int s = 0; s < cap->size; s++) {
+        histo_record(&op->sizes, ivec_size(cvmap_keys(&cap->states[s]->color_to_nodes)));
+    }
+    return 0;
+}
+
+// the keys of a captured map have erased entries, a copy keeps them, run before any other cvmap_keys
+// return NA if alloc fails
+static int bench_keys(const Captured *cap, ColorVecMap *map, OpResult ops[2], int repeat)
+{
+    for (int s = 0; s < cap->size; s++) {
+        int size = ivec_size(&cap->states[s]->color_to_nodes.list);
+        histo_record(&ops[0].sizes, size);
+        histo_record(&ops[1].sizes, size);
+    }
+    ops[0].name = "cvmap_keys (compacting)";
+    ops[1].name = "cvmap_keys (clean)";
+    for (int r = 0; r < repeat; r++) {
+        long sink = 0;
+        int64_t ns[2] = { 0, 0 };
+        for (int s = 0; s < cap->size; s++) {
+            GUARD(cvmap_copy(&cap->states[s]->color_to_nodes, map));
+            for (int k = 0; k < 2; k++) {
+                const int64_t start = timing_now_ns();
+                sink += ivec_size(cvmap_keys(map));
+                ns[k] += timing_now_ns() - start;
+            }
+        }
+        for (int k = 0; k < 2; k++) {
+            ops[k].ns[r] = ns[k];
+            ops[k].calls = cap->size;
+        }
+        g_sink += sink;
+    }
+    return 0;
+}
+
+// return NA if alloc fails
+static int bench_copy(const Captured *cap, ColorVecMap *map, OpResult *op, int repeat)
+{
+    op->name = "cvmap_copy";
+    for (int r = 0; r < repeat; r++) {
+        const int64_t start = timing_now_ns();
+        for (int s = 0; s < cap->size; s++) {
+            GUARD(cvmap_copy(&cap->states[s]->color_to_nodes, map));
+            GUARD(cvmap_copy(&cap->states[s]->color_to_exclusion_idx, map));
+            GUARD(cvmap_copy(&cap->states[s]->true_to_false_colors, map));
+        }
+        op->ns[r] = timing_now_ns() - start;
+        op->calls = 3 * cap->size;
+    }
+    for (int s = 0; s < cap->size; s++) {
+        histo_record(&op->sizes, ivec_size(cvmap_keys(&cap->states[s]->color_to_nodes)));
+        histo_record(&op->sizes, ivec_size(cvmap_keys(&cap->states[s]->color_to_exclusion_idx)));
+        histo_record(&op->sizes, ivec_size(cvmap_keys(&cap->states[s]->true_to_false_colors)));
+    }
+    return 0;
+}
+
+// one clear by color of each state, as grid_validate_check_cycle
+static void bench_vmap_clear(const Captured *cap, VertexMap *map, OpResult *op, int repeat)
+{
+    op->name = "vmap_clear";
+    long calls = 0;
+    for (int s = 0; s < cap->size; s++) {
+        calls += ivec_size(cvmap_keys(&cap->states[s]->color_to_nodes));
+    }
+    for (int r = 0; r < repeat; r++) {
+        const int64_t start = timing_now_ns();
+        for (long i = 0; i < calls; i++) {
+            vmap_clear(map);
+            g_sink += map->store[i & 1][i % (2 * N * NN + 1)];
+        }
+        op->ns[r] = timing_now_ns() - start;
+        op->calls = calls;
+    }
+    histo_record(&op->sizes, 2 * (2 * N * NN + 1));
+}
+
+int main(int argc, char *argv[])
+{
+    int repeat = 20, max_grids = 40;
+    const char *path = (D == 3 ? "../grids/hardGrids.txt" : D == 4 ? "../grids/16x16HardGrids.txt"
+                        : D == 5 ? "../grids/25x25HardGrids.txt" : NULL);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-grids") == 0 && i + 1 < argc) {
+            max_grids = atoi(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!path || repeat < 1 || repeat > kMaxRepeat || max_grids < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // the captured states, maps and results are large, keep them off the stack
+    static Captured cap;
+    static ColorVecMap map;
+    static VertexMap vmap;
+    static OpResult ops[7];
+    cvmap_init(&map);
+    vmap_clear(&vmap);
+    for (int i = 0; i < 7; i++) {
+        histo_clear(&ops[i].sizes);
+    }
+
+    int result = EXIT_SUCCESS;
+    if (capture(&cap, path, max_grids) == NA) {
+        result = EXIT_FAILURE;
+    } else if (cap.size == 0) {
+        fprintf(stderr, "%s : every grid is solved before SCC, nothing to capture\n", path);
+        result = EXIT_FAILURE;
+    } else {
+        fprintf(stderr, "%d states captured from %s, D = %d\n", cap.size, path, D);
+        if (bench_keys(&cap, &map, &ops[3], repeat) == NA || bench_erase(&cap, &ops[1], repeat) == NA
+                || bench_insert(&cap, &map, &ops[2], repeat) == NA || bench_copy(&cap, &map, &ops[5], repeat) == NA) {
+            result = EXIT_FAILURE;
+        } else {
+            bench_find(&cap, &ops[0], repeat);
+            bench_vmap_clear(&cap, &vmap, &ops[6], repeat);
+            for (int i = 0; i < 7; i++) {
+                op_report(&ops[i], repeat);
+            }
+        }
+    }
+
+    cvmap_free(&map);
+    for (int s = 0; s < cap.size; s++) {
+        grid_free(cap.states[s]);
+        free(cap.states[s]);
+    }
+
+    return result;
+}
@@ -0,0 +1,139 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// syscall
+#define _GNU_SOURCE
+
+#include "perf.h"
+#include "consts.h"
+
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const char *const kPerfNames[kPerfCount] = { "cycles", "instructions", "llc_misses", "branch_misses" };
+
+const char *perf_counter_name(int counter)
+{
+    return (counter >= 0 && counter < kPerfCount) ? kPerfNames[counter] : "unknown";
+}
+
+#ifdef __linux__
+
+static int perf_open_event(uint64_t config, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0x00, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = (group_fd == -1);
+    // user space only, allowed with perf_event_paranoid up to 2
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+int perf_open(PerfCounters *pc)
+{
+    static const uint64_t configs[kPerfCount] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    pc->opened_cnt = 0;
+    for (int i = 0; i < kPerfCount; i++) {
+        pc->fds[i] = -1;
+        pc->slots[i] = NA;
+    }
+    for (int i = 0; i < kPerfCount; i++) {
+        pc->fds[i] = perf_open_event(configs[i], pc->fds[kPerfCycles]);
+        if (pc->fds[i] == -1) {
+            PRINT_INFO("%s counter %s not available\n", __func__, kPerfNames[i]);
+            if (i == kPerfCycles) {
+                return NA;
+            }
+            continue;
+        }
+        pc->slots[i] = pc->opened_cnt++;
+    }
+    ioctl(pc->fds[kPerfCycles], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(pc->fds[kPerfCycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return 0;
+}
+
+void perf_close(PerfCounters *pc)
+{
+    if (pc->fds[kPerfCycles] != -1) {
+        ioctl(pc->fds[kPerfCycles], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+    for (int i = 0; i < kPerfCount; i++) {
+        if (pc->fds[i] != -1) {
+            close(pc->fds[i]);
+            pc->fds[i] = -1;
+        }
+    }
+    pc->opened_cnt = 0;
+}
+
+void perf_read(const PerfCounters *pc, uint64_t values[kPerfCount])
+{
+    // PERF_FORMAT_GROUP : the number of counters then their values, in opening order
+    uint64_t buf[1 + kPerfCount];
+    memset(values, 0x00, kPerfCount * sizeof(uint64_t));
+    ssize_t size = (1 + pc->opened_cnt) * sizeof(uint64_t);
+    if (pc->opened_cnt == 0 || read(pc->fds[kPerfCycles], buf, size) != size) {
+        return;
+    }
+    for (int i = 0; i < kPerfCount; i++) {
+        if (pc->slots[i] != NA) {
+            values[i] = buf[1 + pc->slots[i]];
+        }
+    }
+}
+
+#else
+
+int perf_open(PerfCounters *pc)
+{
+    pc->opened_cnt = 0;
+    for (int i = 0; i < kPerfCount; i++) {
+        pc->fds[i] = -1;
+        pc->slots[i] = NA;
+    }
+    return NA;
+}
+
+void perf_close(PerfCounters *pc)
+{
+    pc->opened_cnt = 0;
+}
+
+void perf_read(const PerfCounters *pc, uint64_t values[kPerfCount])
+{
+    (void)pc;
+    memset(values, 0x00, kPerfCount * sizeof(uint64_t));
+}
+
+#endif
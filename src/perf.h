@@ -0,0 +1,59 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+
+/*
+ * Summary:
+ *
+ * Hardware counters by perf_event_open (Linux only), read around each grid_solve stage when enabled.
+ * One group : cycles, instructions, last level cache misses, branch misses, user space only.
+ * A counter the kernel or the CPU denies reads as 0, if cycles is denied nothing is counted
+ * and the callers fall back to the timings alone.
+ */
+
+enum {
+    kPerfCycles = 0,
+    kPerfInstructions = 1,
+    kPerfLLCMisses = 2,
+    kPerfBranchMisses = 3,
+    kPerfCount = 4
+};
+
+typedef struct
+{
+    int fds[kPerfCount]; // -1 if not opened, fds[kPerfCycles] is the group leader
+    int slots[kPerfCount]; // index of the counter in a group read, NA if not opened
+    int opened_cnt;
+} PerfCounters;
+
+// open and start the counters of the calling thread
+// return NA if the counters are not available, nothing to close then
+int  perf_open(PerfCounters *pc);
+// stop and close
+void perf_close(PerfCounters *pc);
+// current values, 0 for a counter not opened
+void perf_read(const PerfCounters *pc, uint64_t values[kPerfCount]);
+// name of a counter, for logs
+const char *perf_counter_name(int counter);
+
+#endif // PERF_H
@@ -0,0 +1,223 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "search.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int gsearch_init(GridSearch *gs, long node_limit)
+{
+    memset(gs->grids, 0x00, sizeof(gs->grids));
+    gs->grid_cnt = 0;
+    gs->node_limit = node_limit;
+    gs->node_cnt = 0;
+    gs->limit_reached = 0;
+    gs->solution_str[0] = '\0';
+    memset(gs->stage_stats, 0x00, sizeof(gs->stage_stats));
+    return 0;
+}
+
+void gsearch_free(GridSearch *gs)
+{
+    for (int i = 0; i < gs->grid_cnt; i++) {
+        grid_free(gs->grids[i]);
+        free(gs->grids[i]);
+        gs->grids[i] = NULL;
+    }
+    gs->grid_cnt = 0;
+}
+
+// grids are kept between searches, their storage is reused by grid_copy
+static Grid *gsearch_grid_at(GridSearch *gs, int depth)
+{
+    assert(depth < NN);
+    while (gs->grid_cnt <= depth) {
+        Grid *grid = malloc(sizeof(Grid));
+        if (!grid) {
+            return NULL;
+        }
+        if (grid_init(grid) == NA) {
+            free(grid);
+            return NULL;
+        }
+        gs->grids[gs->grid_cnt++] = grid;
+    }
+    return gs->grids[depth];
+}
+
+// a contradiction can be lost by the Grid as a color validated twice is skipped
+// so the solution must agree with the nodes validated at the root and with the branch assumptions
+static int gsearch_check_solution(const GridSearch *gs, int depth)
+{
+    for (int i = 0; i < NN; i++) {
+        NodeId node_id = gs->root_nodes[i];
+        if (node_id != NA && gs->bit_grid.placed[i] != (CandMask)1 << (node_id % N)) {
+            return 0;
+        }
+    }
+    for (int j = 0; j < depth; j++) {
+        NodeId node_id = gs->path[j];
+        if (gs->bit_grid.placed[node_id / N] != (CandMask)1 << (node_id % N)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// grid is as left by grid_solve and is not modified, the branches use the grids from depth + 1
+// return NA if alloc fails, else the number of solutions found, at most limit
+static int gsearch_dfs(GridSearch *gs, Grid *grid, int depth, int limit)
+{
+    // grid_solve finds some contradictions only (invalid), the bit grid checks the rest
+    if (grid->invalid) {
+        return 0;
+    }
+    grid_get_cands_str(grid, gs->cands_str);
+    if (bgrid_populate_cands(&gs->bit_grid, gs->cands_str) == NA
+            || bgrid_solve_singles(&gs->bit_grid) == NA) {
+        return 0;
+    }
+    if (gs->bit_grid.placed_size == NN) {
+        if (!gsearch_check_solution(gs, depth)) {
+            return 0;
+        }
+        if (gs->solution_str[0] == '\0') {
+            bgrid_get_grid_str(&gs->bit_grid, gs->solution_str);
+        }
+        return 1;
+    }
+
+    // MRV : branch on the cell with the fewest candidates
+    int cell = NA, cell_cnt = N + 1;
+    for (int i = 0; i < NN; i++) {
+        int cnt = cmask_count(gs->bit_grid.cands[i]);
+        if (cnt > 1 && cnt < cell_cnt) {
+            cell = i, cell_cnt = cnt;
+        }
+    }
+    assert(cell != NA);
+    CandMask cands = gs->bit_grid.cands[cell];
+
+    Grid *child = gsearch_grid_at(gs, depth);
+    if (!child) {
+        return NA;
+    }
+    int result = 0, ret = 0;
+    for (; cands != 0 && result < limit; cands &= cands - 1) {
+        // the limits of the grids stop the search as the node limit
+        if ((gs->node_limit != 0 && gs->node_cnt >= gs->node_limit) || grid_limits_expired(grid)) {
+            gs->limit_reached = 1;
+            break;
+        }
+        gs->node_cnt++;
+        gs->path[depth] = cell * N + cmask_first(cands);
+        GUARD(grid_copy(grid, child));
+        GUARD(grid_assume_node(child, gs->path[depth]));
+        ret = grid_solve(child);
+        // the child starts with the stats of its parent
+        grid_stats_add(gs->stage_stats, child->stage_stats, grid->stage_stats);
+#ifdef CHECK_GRID
+        // NA is also the invalid grid flag, the branch is dead
+        if (ret == NA) {
+            continue;
+        }
+#else
+        GUARD(ret);
+#endif
+        if (child->invalid || child->validated_nodes[cell] != gs->path[depth]) {
+            continue;
+        }
+        // stopped before its fixed point, the branch is not checked
+        if (ret != NN && grid_limits_expired(child)) {
+            gs->limit_reached = 1;
+            break;
+        }
+        ret = gsearch_dfs(gs, child, depth + 1, limit - result);
+        GUARD(ret);
+        result += ret;
+    }
+    return result;
+}
+
+int gsearch_solve(GridSearch *gs, Grid *grid)
+{
+    gs->node_cnt = 0;
+    gs->limit_reached = 0;
+    gs->solution_str[0] = '\0';
+    memset(gs->stage_stats, 0x00, sizeof(gs->stage_stats));
+
+    if (grid->invalid) {
+        return grid->validated_size;
+    }
+    if (grid->validated_size == NN) {
+        return NN;
+    }
+    memcpy(gs->root_nodes, grid->validated_nodes, NN * sizeof(NodeId));
+    int ret = gsearch_dfs(gs, grid, 0, 1);
+    GUARD(ret);
+    PRINT_INFO("%s %d solution(s) %ld branch(es)\n", __func__, ret, gs->node_cnt);
+    if (ret == 0) {
+        return grid->validated_size;
+    }
+
+    // replay the solution on the grid
+    for (int i = 0; i < NN; i++) {
+        GUARD(grid_assume_node(grid, i * N + grid_char_to_int(gs->solution_str[i])));
+    }
+    return grid_solve(grid);
+}
+
+int gsearch_count(GridSearch *gs, Grid *grid, int limit)
+{
+    gs->node_cnt = 0;
+    gs->limit_reached = 0;
+    gs->solution_str[0] = '\0';
+    memset(gs->stage_stats, 0x00, sizeof(gs->stage_stats));
+
+    // a grid solved by grid_solve still needs the validity check of the search
+    memcpy(gs->root_nodes, grid->validated_nodes, NN * sizeof(NodeId));
+    int ret = gsearch_dfs(gs, grid, 0, limit);
+    PRINT_INFO("%s %d solution(s) %ld branch(es)\n", __func__, ret, gs->node_cnt);
+    return ret;
+}
+
+int grid_count_solutions(Grid *grid, int limit)
+{
+    int ret = grid_solve(grid);
+#ifdef CHECK_GRID
+    if (ret == NA) {
+        return 0;
+    }
+#else
+    GUARD(ret);
+#endif
+    if (grid->invalid) {
+        return 0;
+    }
+    GridSearch *gs = malloc(sizeof(GridSearch));
+    if (!gs) {
+        return NA;
+    }
+    gsearch_init(gs, 0);
+    ret = gsearch_count(gs, grid, limit);
+    gsearch_free(gs);
+    free(gs);
+    return ret;
+}
@@ -0,0 +1,70 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "bitgrid.h"
+#include "consts.h"
+#include "grid.h"
+
+/*
+ * Summary:
+ *
+ * Fallback for the grids grid_solve can not finish : depth first search on the candidates left.
+ * At each branch grid_solve is the propagator, the candidates it leaves are loaded in a BitGrid
+ * to detect a contradiction and to pick the cell with the fewest candidates (MRV) as next branch.
+ * Counting uses the same search and stops as soon as the limit is reached : a grid grid_solve finishes
+ * has one solution without any branch, since every deduction holds for every solution.
+ */
+
+typedef struct
+{
+    Grid *grids[NN]; // one Grid by search depth for the branches, a branch validates one node at least
+    int grid_cnt; // number of grids initialized
+    BitGrid bit_grid; // candidates of the branch being checked
+    char cands_str[NN * N + 1]; // same, as returned by grid_get_cands_str
+    NodeId root_nodes[NN]; // nodes validated before the search
+    NodeId path[NN]; // node assumed at each depth of the branch being checked
+    long node_limit; // max number of branches by search, 0 for no limit
+    long node_cnt; // number of branches of the last search
+    int limit_reached; // set if the last search stopped at node_limit or at the limits of the grid (grid_set_limits)
+    char solution_str[NN + 1]; // first solution found by the last search
+    StageStats stage_stats[kStageCount]; // grid_solve stages run by the branches of the last search
+} GridSearch;
+
+// init, node_limit bounds the time of a search, 0 for no limit
+// return NA if alloc fails
+int  gsearch_init(GridSearch *gs, long node_limit);
+// free the allocated memory
+void gsearch_free(GridSearch *gs);
+// solve a grid as left by grid_solve, on success the grid is solved in place
+// return NA if alloc fails, else the number of nodes validated, NN if a solution was found
+// and the grid validated_size if there is no solution or if node_limit was reached
+int  gsearch_solve(GridSearch *gs, Grid *grid);
+// count the solutions of a grid as left by grid_solve, stop at limit, the grid is not modified
+// return NA if alloc fails, else the number of solutions in [0, limit]
+// if node_limit is reached the count is a lower bound, limit_reached is set
+int  gsearch_count(GridSearch *gs, Grid *grid, int limit);
+// grid_solve then count the solutions up to limit with a temporary GridSearch
+// a grid with clues in conflict (grid_populate) or found invalid by grid_solve has no solution, see Grid.invalid
+// return NA if alloc fails, else the number of solutions in [0, limit]
+int  grid_count_solutions(Grid *grid, int limit);
+
+#endif // SEARCH_H
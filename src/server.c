@@ -0,0 +1,626 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Solver server, a separate program from the solver : the workers and their grids are initialized once,
+ * the requests pay the solve only.
+ *
+ * Compilation :
+ *
+ *  cc -std=c99 -DNDEBUG -Wall -Wextra -Werror -O2 -I. server.c histo.c sudoku.c solver.c grid.c bitgrid.c bitbatch.c search.c dlx.c perf.c customtypes.c canon.c cache.c -pthread -o ./rSudokuServer
+ *  add -DD=4 or -DD=5 for 16x16 or 25x25 grids
+ *
+ * Usage :
+ *
+ * ./rSudokuServer --socket /tmp/rsudoku.sock --workers 4 & # serve on a Unix domain socket
+ * ./rSudokuServer --connect /tmp/rsudoku.sock < grids.txt # client, one response by line
+ * ./rSudokuServer --stdio < requests.bin > responses.bin # one connection on stdin and stdout
+ *
+ * Protocol : a frame is a 4 bytes big endian length then that many bytes. A request is a grid string,
+ * a response the text "status answer solve_ns latency_ns" :
+ * - status : solved, unsolved, invalid, malformed, badopts, nomemory or timeout, see sudoku.h
+ * - answer : the solution, in count mode the number of solutions with a '+' when the count stopped early, '-' if none
+ * - solve_ns : time spent by the solver, latency_ns : from the request read to its response ready, queue included
+ * A connection may send any number of requests without waiting for the responses, they come back in the order
+ * of the requests. At most kMaxInflight requests of a connection are read ahead, a frame over kMaxFrame bytes
+ * closes the connection.
+ *
+ * Threads : one reader and one writer by connection, --workers solver threads shared by all the connections,
+ * each one with its own context (sudoku.h) kept for the whole run.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "histo.h"
+#include "solver.h"
+#include "sudoku.h"
+#include "timing.h"
+
+enum {
+    kMaxFrame = 1024, // bytes of a request, a grid string is NN characters
+    kMaxInflight = 64, // requests of a connection read and not answered yet
+    kMaxResponse = NN + 64, // bytes of a response, header excluded
+    kMaxWorkers = 256
+};
+
+typedef struct Conn Conn;
+typedef struct Request Request;
+
+struct Request
+{
+    Conn *conn;
+    Request *next; // in the work queue
+    int64_t start_ns; // request read
+    int done; // response ready
+    int resp_size; // header included
+    char grid_str[kMaxFrame + 1];
+    unsigned char resp[4 + kMaxResponse];
+};
+
+struct Conn
+{
+    int in_fd, out_fd;
+    int owns_fd; // close in_fd at the end, out_fd is the same socket
+    pthread_mutex_t lock;
+    pthread_cond_t cond; // a response ready, a slot free or the end of the requests
+    long head, tail; // next response to write, next request to read, in slots[i % kMaxInflight]
+    int eof; // no more request
+    int broken; // a write failed, the responses left are dropped
+    Request slots[kMaxInflight];
+};
+
+// requests waiting for a worker, all connections
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    Request *first, *last;
+    int stop;
+} WorkQueue;
+
+typedef struct
+{
+    pthread_t thread;
+    SudokuCtx *ctx;
+} Worker;
+
+static WorkQueue queue = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0 };
+// set before the workers start, read only then
+static SudokuOpts solve_opts;
+static volatile sig_atomic_t stop_signal = 0;
+
+static const char *kStatusNames[] = { "solved", "unsolved", "invalid", "malformed", "badopts", "nomemory", "timeout" };
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage : %s --socket path | --stdio | --connect path [options]\n"
+            " --socket path       serve on a Unix domain socket, the path must not exist\n"
+            " --stdio             serve one connection on stdin and stdout\n"
+            " --connect path      client : send the grids of stdin to the server, print the responses\n"
+            " --workers n         solver threads, default the number of cpus\n"
+            " --engine e          engine for the grids the singles do not solve : color, color+search or dlx\n"
+            " --search            finish the grids the color solver can not with the search\n"
+            " --search-limit n    max number of branches by grid for the search or dlx, 0 for no limit\n"
+            " --count             answer the number of solutions instead of a solution\n"
+            " --count-limit n     count limit, default 2\n"
+            " --adaptive          adaptive scheduling of the grid_solve stages\n"
+            " --deadline us       time by request, then the answer is the partial solution, 0 for no limit\n"
+            " --op-budget n       vertices visited by the grid_solve searches by request, same, 0 for no limit\n",
+            name);
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_signal = 1;
+}
+
+// the signals go to the main thread only, its accept is interrupted
+static void block_signals(void)
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+// return 0, NA on error or end of file
+static int read_full(int fd, void *buf, size_t size)
+{
+    char *p = buf;
+    while (size > 0) {
+        ssize_t ret = read(fd, p, size);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return NA;
+        }
+        p += ret, size -= ret;
+    }
+    return 0;
+}
+
+// return 0, NA on error
+static int write_full(int fd, const void *buf, size_t size)
+{
+    const char *p = buf;
+    while (size > 0) {
+        ssize_t ret = write(fd, p, size);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return NA;
+        }
+        p += ret, size -= ret;
+    }
+    return 0;
+}
+
+static void put_be32(unsigned char *p, uint32_t v)
+{
+    p[0] = v >> 24, p[1] = v >> 16, p[2] = v >> 8, p[3] = v;
+}
+
+static uint32_t get_be32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// read a frame into buf, return its size, NA at the end of the input, on error or for a frame over max_size
+static int read_frame(int fd, char *buf, int max_size)
+{
+    unsigned char header[4];
+    if (read_full(fd, header, 4) == NA) {
+        return NA;
+    }
+    uint32_t size = get_be32(header);
+    if (size > (uint32_t)max_size) {
+        fprintf(stderr, "frame of %lu bytes over %d, connection closed\n", (unsigned long)size, max_size);
+        return NA;
+    }
+    if (read_full(fd, buf, size) == NA) {
+        return NA;
+    }
+    return size;
+}
+
+static void queue_push(Request *req)
+{
+    req->next = NULL;
+    pthread_mutex_lock(&queue.lock);
+    if (queue.last) {
+        queue.last->next = req;
+    } else {
+        queue.first = req;
+    }
+    queue.last = req;
+    pthread_cond_signal(&queue.cond);
+    pthread_mutex_unlock(&queue.lock);
+}
+
+// return the next request, NULL once stopped and empty
+static Request *queue_pop(void)
+{
+    pthread_mutex_lock(&queue.lock);
+    while (!queue.first && !queue.stop) {
+        pthread_cond_wait(&queue.cond, &queue.lock);
+    }
+    Request *req = queue.first;
+    if (req) {
+        queue.first = req->next;
+        if (!queue.first) {
+            queue.last = NULL;
+        }
+    }
+    pthread_mutex_unlock(&queue.lock);
+    return req;
+}
+
+static void queue_stop(void)
+{
+    pthread_mutex_lock(&queue.lock);
+    queue.stop = 1;
+    pthread_cond_broadcast(&queue.cond);
+    pthread_mutex_unlock(&queue.lock);
+}
+
+// solve the grid of req and write its response frame
+static void solve_request(SudokuCtx *ctx, Request *req)
+{
+    char out[NN + 1];
+    int status = sudoku_solve(ctx, req->grid_str, out, &solve_opts);
+    SudokuInfo info;
+    sudoku_last_info(ctx, &info);
+
+    char answer[NN + 16] = "-";
+    if (status < kSudokuMalformed || status == kSudokuTimedOut) {
+        if (solve_opts.count_limit > 0) {
+            snprintf(answer, sizeof(answer), "%d%s", info.solutions,
+                    (info.solutions == solve_opts.count_limit && solve_opts.count_limit > 1) || info.lower_bound ? "+" : "");
+        } else {
+            memcpy(answer, out, NN + 1);
+        }
+    }
+    long long latency = timing_now_ns() - req->start_ns;
+    int size = snprintf((char *)req->resp + 4, kMaxResponse, "%s %s %ld %lld",
+                        kStatusNames[status], answer, info.ns, latency);
+    put_be32(req->resp, size);
+    req->resp_size = 4 + size;
+}
+
+static void *worker_run(void *arg)
+{
+    block_signals();
+    Worker *worker = arg;
+    Request *req;
+    while ((req = queue_pop())) {
+        solve_request(worker->ctx, req);
+        // req belongs to its connection again once done is set
+        Conn *conn = req->conn;
+        pthread_mutex_lock(&conn->lock);
+        req->done = 1;
+        pthread_cond_broadcast(&conn->cond);
+        pthread_mutex_unlock(&conn->lock);
+    }
+    return NULL;
+}
+
+// write the responses in the order of the requests, until the end of the requests and all answered
+static void *conn_write_run(void *arg)
+{
+    block_signals();
+    Conn *conn = arg;
+    pthread_mutex_lock(&conn->lock);
+    for (;;) {
+        while (conn->head == conn->tail ? !conn->eof : !conn->slots[conn->head % kMaxInflight].done) {
+            pthread_cond_wait(&conn->cond, &conn->lock);
+        }
+        if (conn->head == conn->tail) {
+            break;
+        }
+        Request *req = &conn->slots[conn->head % kMaxInflight];
+        int broken = conn->broken;
+        pthread_mutex_unlock(&conn->lock);
+        int ret = (broken ? NA : write_full(conn->out_fd, req->resp, req->resp_size));
+        pthread_mutex_lock(&conn->lock);
+        conn->broken |= (ret == NA);
+        conn->head++;
+        pthread_cond_broadcast(&conn->cond);
+    }
+    pthread_mutex_unlock(&conn->lock);
+    return NULL;
+}
+
+// read the requests of a connection until its end, then free it
+static void *conn_run(void *arg)
+{
+    block_signals();
+    Conn *conn = arg;
+    pthread_t writer;
+    int writer_ready = (pthread_create(&writer, NULL, conn_write_run, conn) == 0);
+    while (writer_ready) {
+        pthread_mutex_lock(&conn->lock);
+        while (conn->tail - conn->head == kMaxInflight && !conn->broken) {
+            pthread_cond_wait(&conn->cond, &conn->lock);
+        }
+        int broken = conn->broken;
+        pthread_mutex_unlock(&conn->lock);
+        if (broken) {
+            break;
+        }
+        // the slot is free : its response was written, and only this thread moves tail
+        Request *req = &conn->slots[conn->tail % kMaxInflight];
+        int size = read_frame(conn->in_fd, req->grid_str, kMaxFrame);
+        if (size == NA) {
+            break;
+        }
+        req->grid_str[size] = '\0';
+        req->start_ns = timing_now_ns();
+        req->conn = conn;
+        req->done = 0;
+        pthread_mutex_lock(&conn->lock);
+        conn->tail++;
+        pthread_mutex_unlock(&conn->lock);
+        queue_push(req);
+    }
+    if (writer_ready) {
+        pthread_mutex_lock(&conn->lock);
+        conn->eof = 1;
+        pthread_cond_broadcast(&conn->cond);
+        pthread_mutex_unlock(&conn->lock);
+        // the requests in flight are answered before the connection is freed
+        pthread_join(writer, NULL);
+    }
+    if (conn->owns_fd) {
+        close(conn->in_fd);
+    }
+    pthread_cond_destroy(&conn->cond);
+    pthread_mutex_destroy(&conn->lock);
+    free(conn);
+    return NULL;
+}
+
+// return NULL if alloc fails
+static Conn *conn_new(int in_fd, int out_fd, int owns_fd)
+{
+    Conn *conn = malloc(sizeof(Conn));
+    if (!conn) {
+        return NULL;
+    }
+    conn->in_fd = in_fd;
+    conn->out_fd = out_fd;
+    conn->owns_fd = owns_fd;
+    pthread_mutex_init(&conn->lock, NULL);
+    pthread_cond_init(&conn->cond, NULL);
+    conn->head = conn->tail = 0;
+    conn->eof = conn->broken = 0;
+    return conn;
+}
+
+// return NA if a worker can not be started
+static int workers_start(Worker *workers, int count)
+{
+    for (int i = 0; i < count; i++) {
+        workers[i].ctx = sudoku_ctx_create();
+        if (!workers[i].ctx || pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]) != 0) {
+            sudoku_ctx_destroy(workers[i].ctx);
+            queue_stop();
+            for (int j = 0; j < i; j++) {
+                pthread_join(workers[j].thread, NULL);
+                sudoku_ctx_destroy(workers[j].ctx);
+            }
+            return NA;
+        }
+    }
+    return 0;
+}
+
+static void workers_stop(Worker *workers, int count)
+{
+    queue_stop();
+    for (int i = 0; i < count; i++) {
+        pthread_join(workers[i].thread, NULL);
+        sudoku_ctx_destroy(workers[i].ctx);
+    }
+}
+
+// return NA if the socket can not be bound
+static int serve_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s : path too long\n", path);
+        return NA;
+    }
+    memset(&addr, 0x00, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, 64) != 0) {
+        perror(path);
+        if (listen_fd >= 0) {
+            close(listen_fd);
+        }
+        return NA;
+    }
+
+    // no SA_RESTART : a signal interrupts accept
+    struct sigaction sa;
+    memset(&sa, 0x00, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    while (!stop_signal) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                perror("accept");
+                break;
+            }
+            continue;
+        }
+        Conn *conn = conn_new(fd, fd, 1);
+        pthread_t thread;
+        if (!conn || pthread_create(&thread, NULL, conn_run, conn) != 0) {
+            fprintf(stderr, "connection dropped\n");
+            free(conn);
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    // the connections still open are cut by the exit
+    close(listen_fd);
+    unlink(path);
+    return 0;
+}
+
+// client side, the grids of stdin as requests
+static void *client_send_run(void *arg)
+{
+    int fd = *(int *)arg;
+    char scan_fmt[16];
+    snprintf(scan_fmt, sizeof(scan_fmt), " %%%ds", kMaxFrame);
+    static unsigned char frame[4 + kMaxFrame + 1];
+    while (scanf(scan_fmt, (char *)frame + 4) == 1) {
+        size_t size = strlen((char *)frame + 4);
+        put_be32(frame, size);
+        if (write_full(fd, frame, 4 + size) == NA) {
+            break;
+        }
+    }
+    // the server answers what it got then closes
+    shutdown(fd, SHUT_WR);
+    return NULL;
+}
+
+// send the grids of stdin, print the responses, return NA if the connection fails
+static int client_run(const char *path)
+{
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s : path too long\n", path);
+        return NA;
+    }
+    memset(&addr, 0x00, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror(path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NA;
+    }
+    int64_t start = timing_now_ns();
+    pthread_t sender;
+    if (pthread_create(&sender, NULL, client_send_run, &fd) != 0) {
+        close(fd);
+        return NA;
+    }
+    // latency reported by the server
+    static Histo latency;
+    histo_clear(&latency);
+    static char resp[kMaxResponse + 1];
+    int size;
+    while ((size = read_frame(fd, resp, kMaxResponse)) != NA) {
+        resp[size] = '\0';
+        printf("%s\n", resp);
+        const char *last = strrchr(resp, ' ');
+        if (last) {
+            histo_record(&latency, strtoull(last + 1, NULL, 10));
+        }
+    }
+    pthread_join(sender, NULL);
+    close(fd);
+    double wall_s = (timing_now_ns() - start) / 1e9;
+    fprintf(stderr, "%llu responses in %.3f s, %.0f grids/s, latency p50 %.1f us p99 %.1f us max %.1f us\n",
+            (unsigned long long)latency.count, wall_s, wall_s > 0 ? latency.count / wall_s : 0,
+            histo_percentile(&latency, 50) / 1e3, histo_percentile(&latency, 99) / 1e3, latency.max / 1e3);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *socket_path = NULL, *connect_path = NULL;
+    int use_stdio = 0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int worker_cnt = (cpus > 0 ? (int)cpus : 1);
+    int count_mode = 0, count_limit = 2;
+    sudoku_default_opts(&solve_opts);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--stdio") == 0) {
+            use_stdio = 1;
+        } else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+            connect_path = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            worker_cnt = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            int engine = solver_engine_from_name(argv[++i]);
+            if (engine == kEngineColor) {
+                solve_opts.engine = kSudokuEngineColor;
+            } else if (engine == kEngineColorSearch) {
+                solve_opts.engine = kSudokuEngineColorSearch;
+            } else if (engine == kEngineDlx) {
+                solve_opts.engine = kSudokuEngineDlx;
+            } else {
+                fprintf(stderr, "unknown engine %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--search") == 0) {
+            solve_opts.search = 1;
+        } else if (strcmp(argv[i], "--search-limit") == 0 && i + 1 < argc) {
+            solve_opts.search_limit = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--count") == 0) {
+            count_mode = 1;
+        } else if (strcmp(argv[i], "--count-limit") == 0 && i + 1 < argc) {
+            count_limit = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            solve_opts.adaptive = 1;
+        } else if (strcmp(argv[i], "--deadline") == 0 && i + 1 < argc) {
+            solve_opts.deadline_us = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--op-budget") == 0 && i + 1 < argc) {
+            solve_opts.op_budget = atol(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if ((socket_path != NULL) + use_stdio + (connect_path != NULL) != 1
+            || worker_cnt < 1 || worker_cnt > kMaxWorkers || count_limit < 1 || solve_opts.search_limit < 0
+            || solve_opts.deadline_us < 0 || solve_opts.op_budget < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    solve_opts.count_limit = (count_mode ? count_limit : 0);
+
+    // a peer gone shows as a write error
+    signal(SIGPIPE, SIG_IGN);
+
+    if (connect_path) {
+        return client_run(connect_path) == NA ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    static Worker workers[kMaxWorkers];
+    if (workers_start(workers, worker_cnt) == NA) {
+        fprintf(stderr, "init failed\n");
+        return EXIT_FAILURE;
+    }
+    int result = EXIT_SUCCESS;
+    if (use_stdio) {
+        Conn *conn = conn_new(STDIN_FILENO, STDOUT_FILENO, 0);
+        if (conn) {
+            conn_run(conn);
+        } else {
+            fprintf(stderr, "alloc failed\n");
+            result = EXIT_FAILURE;
+        }
+    } else {
+        fprintf(stderr, "serving on %s with %d workers\n", socket_path, worker_cnt);
+        if (serve_socket(socket_path) == NA) {
+            result = EXIT_FAILURE;
+        }
+    }
+    // the socket mode exits without waiting for the connections still open
+    if (use_stdio) {
+        workers_stop(workers, worker_cnt);
+    }
+
+    return result;
+}
@@ -0,0 +1,482 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// clock_gettime
+#define _POSIX_C_SOURCE 200809L
+
+#include "solver.h"
+#include "timing.h"
+
+#include <string.h>
+
+static const char *const kClassNames[kClassCount] = { "singles", "medium", "hard", "invalid" };
+static const char *const kEngineNames[kEngineCount] = { "singles", "color", "color+search", "dlx" };
+
+const char *solver_class_name(int difficulty)
+{
+    return (difficulty >= 0 && difficulty < kClassCount) ? kClassNames[difficulty] : "unrated";
+}
+
+const char *solver_engine_name(int engine)
+{
+    return (engine >= 0 && engine < kEngineCount) ? kEngineNames[engine] : "none";
+}
+
+int solver_engine_from_name(const char *name)
+{
+    for (int i = 0; i < kEngineCount; i++) {
+        if (strcmp(name, kEngineNames[i]) == 0) {
+            return i;
+        }
+    }
+    return NA;
+}
+
+int solver_class_from_name(const char *name)
+{
+    for (int i = 0; i < kClassCount; i++) {
+        if (strcmp(name, kClassNames[i]) == 0) {
+            return i;
+        }
+    }
+    return NA;
+}
+
+void solver_default_opts(SolverOpts *opts)
+{
+    opts->routes[kClassSingles] = kEngineSingles;
+    opts->routes[kClassMedium] = kEngineColor;
+    opts->routes[kClassHard] = kEngineColorSearch;
+    opts->routes[kClassInvalid] = kEngineSingles;
+    // about 3 colors by empty cell of a 9x9 grid, scaled by grid size
+    opts->color_threshold = 2 * NN;
+    opts->search_limit = 0;
+    opts->count_mode = 0;
+    opts->count_limit = 2;
+    opts->stage_mask = kStageAll;
+    opts->adaptive = 0;
+    opts->perf = 0;
+    opts->route_log = NULL;
+    opts->deadline_us = 0;
+    opts->op_budget = 0;
+    opts->cache_size = 0;
+}
+
+// NOTE: if fails no need to call solver_free
+int solver_init(Solver *solver, const SolverOpts *opts)
+{
+    solver->opts = *opts;
+    solver->dlx_ready = 0;
+    solver->perf_enabled = 0;
+    solver->grid_saved = 0;
+    // a disabled cache is an empty one, rcache_clear may still be called
+    memset(&solver->cache, 0x00, sizeof(solver->cache));
+    bbatch_init(&solver->bit_batch);
+    gsearch_init(&solver->search, opts->search_limit);
+    if (grid_init(&solver->base_grid) == NA) {
+        return NA;
+    }
+    if (grid_init(&solver->grid) == NA) {
+        grid_free(&solver->base_grid);
+        return NA;
+    }
+    if (opts->cache_size > 0 && rcache_init(&solver->cache, opts->cache_size) == NA) {
+        grid_free(&solver->grid);
+        grid_free(&solver->base_grid);
+        return NA;
+    }
+    // init one time here, then copy before populating the active grid
+    if (grid_init_data(&solver->base_grid) == NA) {
+        solver_free(solver);
+        return NA;
+    }
+    grid_set_stages(&solver->base_grid, opts->stage_mask, opts->adaptive);
+    grid_limits_reset(&solver->limits, 0, 0);
+    grid_set_limits(&solver->base_grid, &solver->limits);
+    // the kernel may deny the counters, not an error
+    solver->perf_enabled = (opts->perf && perf_open(&solver->perf) != NA);
+    if (solver->perf_enabled) {
+        grid_set_perf(&solver->base_grid, &solver->perf);
+    }
+    return 0;
+}
+
+void solver_free(Solver *solver)
+{
+    if (solver->perf_enabled) {
+        perf_close(&solver->perf);
+        solver->perf_enabled = 0;
+    }
+    gsearch_free(&solver->search);
+    if (solver->cache.capacity > 0) {
+        rcache_free(&solver->cache);
+    }
+    grid_free(&solver->grid);
+    grid_free(&solver->base_grid);
+}
+
+void solver_set_opts(Solver *solver, const SolverOpts *opts)
+{
+    const SolverOpts old = solver->opts;
+    solver->opts = *opts;
+    solver->opts.perf = old.perf;
+    solver->opts.cache_size = old.cache_size;
+    // a count cached is a count up to count_limit, a solution is a solution whatever the engine
+    if (opts->count_mode != old.count_mode || opts->count_limit != old.count_limit) {
+        rcache_clear(&solver->cache);
+    }
+    solver->search.node_limit = opts->search_limit;
+    // dlx_init resets it, solver_run_dlx sets it again on first use
+    solver->dlx.branch_limit = opts->search_limit;
+    grid_set_stages(&solver->base_grid, opts->stage_mask, opts->adaptive);
+}
+
+// set the time spent and log the routing decision
+static void solver_done(const Solver *solver, SolveResult *result, int64_t start)
+{
+    result->ns = timing_now_ns() - start;
+#ifdef MEM_STATS
+    mem_stats_end(&solver->mem_start, &result->mem);
+    result->grid_bytes = grid_mem_bytes(&solver->base_grid) + grid_mem_bytes(&solver->grid);
+    for (int i = 0; i < solver->search.grid_cnt; i++) {
+        result->grid_bytes += grid_mem_bytes(solver->search.grids[i]);
+    }
+    result->rss_bytes = mem_rss_bytes();
+#endif
+    if (solver->opts.route_log) {
+        solver_print_route(solver->opts.route_log, result);
+    }
+}
+
+void solver_print_route(FILE *f, const SolveResult *result)
+{
+    long us = result->ns / 1000;
+    fprintf(f, "route class %s clues %d residual %d colors %d engine %s status %d us %ld\n",
+            solver_class_name(result->difficulty), result->clues, result->residual, result->colors,
+            solver_engine_name(result->engine), result->status, us);
+}
+
+// solve or count with the color solver, the grid may already be populated by the estimate or loaded,
+// base are the stats of the grid before this solve, NULL for none
+static int solver_run_color(Solver *solver, SolveResult *result, int grid_ready, const StageStats *base,
+                            char out[NN + 1])
+{
+    if (!grid_ready) {
+        GUARD(grid_copy(&solver->base_grid, &solver->grid));
+        GUARD(grid_populate(&solver->grid, solver->residual_str));
+    }
+    solver->grid_saved = 1;
+    int ret = grid_solve(&solver->grid);
+    // with CHECK_GRID, NA is also the invalid grid flag
+    if (ret == NA && !solver->grid.invalid) {
+        return NA;
+    }
+    result->validated_size = solver->grid.validated_size;
+    int searched = 0;
+    // an expired grid_solve stops the search at its first branch, count mode gets a lower bound
+    if (solver->opts.count_mode) {
+        ret = gsearch_count(&solver->search, &solver->grid, solver->opts.count_limit);
+        GUARD(ret);
+        result->solution_cnt = ret;
+        result->lower_bound = solver->search.limit_reached;
+        searched = 1;
+    } else if (result->engine == kEngineColorSearch && result->validated_size != NN) {
+        ret = gsearch_solve(&solver->search, &solver->grid);
+        GUARD(ret);
+        result->validated_size = ret;
+        searched = 1;
+    }
+    result->timed_out = solver->limits.expired;
+    grid_stats_add(result->stages, solver->grid.stage_stats, base);
+    if (searched) {
+        grid_stats_add(result->stages, solver->search.stage_stats, NULL);
+        result->branches = solver->search.node_cnt;
+    }
+    grid_get_grid_str(&solver->grid, out);
+    return 0;
+}
+
+static int solver_run_dlx(Solver *solver, SolveResult *result, char out[NN + 1])
+{
+    if (!solver->dlx_ready) {
+        GUARD(dlx_init(&solver->dlx, &solver->base_grid));
+        solver->dlx.branch_limit = solver->opts.search_limit;
+        solver->dlx_ready = 1;
+    }
+    // the residual comes from a valid bit grid, its clues are not in conflict
+    GUARD(dlx_populate(&solver->dlx, solver->residual_str));
+    solver->dlx.deadline_ns = solver->limits.deadline_ns;
+    if (solver->opts.count_mode) {
+        result->solution_cnt = dlx_count_solutions(&solver->dlx, solver->opts.count_limit);
+        result->validated_size = solver->dlx.solution_size;
+        result->lower_bound = solver->dlx.limit_reached;
+    } else {
+        result->validated_size = dlx_solve(&solver->dlx);
+    }
+    result->branches = solver->dlx.branch_cnt;
+    result->timed_out = (solver->dlx.limit_reached && solver->dlx.deadline_ns != 0
+                         && timing_now_ns() >= solver->dlx.deadline_ns);
+    dlx_get_grid_str(&solver->dlx, out);
+    return 0;
+}
+
+// look a grid up by its canonical form, sets result->cache
+// return the value cached, NULL if none
+static const CacheValue *solver_cache_find(Solver *solver, const char *grid_str, SolveResult *result)
+{
+    const int64_t start = timing_now_ns();
+    const CacheValue *value = NULL;
+    if (canon_grid(grid_str, solver->canon_str, &solver->canon) != NA) {
+        grid_pack_str(solver->canon_str, solver->canon_key);
+        value = rcache_find(&solver->cache, solver->canon_key);
+        result->cache = (value != NULL);
+    }
+    result->canon_ns = timing_now_ns() - start;
+    return value;
+}
+
+// a result from the cache, mapped back to the grid
+static void solver_cache_get(Solver *solver, const CacheValue *value, char out[NN + 1], SolveResult *result)
+{
+    result->status = value->status;
+    result->difficulty = value->difficulty;
+    result->engine = value->engine;
+    result->solution_cnt = value->solution_cnt;
+    result->lower_bound = value->lower_bound;
+    grid_unpack_str(value->solution, solver->canon_str);
+    canon_revert(&solver->canon, solver->canon_str, out);
+    result->validated_size = 0;
+    for (int i = 0; i < NN; i++) {
+        result->validated_size += (out[i] != '.');
+    }
+}
+
+// add a result missed by the lookup, a solution or a final count only : not a partial one, which depends
+// on the options, the limits and the time
+static void solver_cache_add(Solver *solver, const char out[NN + 1], const SolveResult *result)
+{
+    if (result->cache != 0 || result->timed_out
+            || (solver->opts.count_mode ? result->lower_bound : result->status != kSolveSolved)) {
+        return;
+    }
+    CacheValue value;
+    value.status = result->status;
+    value.difficulty = result->difficulty;
+    value.engine = result->engine;
+    value.solution_cnt = result->solution_cnt;
+    value.lower_bound = result->lower_bound;
+    canon_apply(&solver->canon, out, solver->canon_str);
+    grid_pack_str(solver->canon_str, value.solution);
+    rcache_insert(&solver->cache, solver->canon_key, &value);
+}
+
+// reset the result and the limits at the start of a solve
+static void solver_start(Solver *solver, SolveResult *result, int64_t start, char out[NN + 1])
+{
+#ifdef MEM_STATS
+    mem_stats_begin(&solver->mem_start);
+#endif
+    memset(result, 0x00, sizeof(SolveResult));
+    result->difficulty = NA;
+    result->engine = kEngineSingles;
+    result->colors = NA;
+    result->cache = NA;
+    memset(out, '.', NN);
+    out[NN] = '\0';
+    grid_limits_reset(&solver->limits, solver->opts.deadline_us != 0 ? start + solver->opts.deadline_us * 1000 : 0,
+                      solver->opts.op_budget);
+}
+
+// status of a grid solved by an engine
+static void solver_set_status(const Solver *solver, SolveResult *result)
+{
+    if (solver->opts.count_mode) {
+        result->status = (result->solution_cnt > 0 ? kSolveSolved
+                          : (result->lower_bound ? kSolveUnsolved : kSolveInvalid));
+    } else if (solver->grid_saved && solver->grid.invalid) {
+        // a contradiction found by the color solver
+        result->status = kSolveInvalid;
+    } else {
+        result->status = (result->validated_size == NN ? kSolveSolved : kSolveUnsolved);
+    }
+}
+
+// the clues of a grid string, for an invalid grid
+static void solver_put_clues(const char *grid_str, char out[NN + 1])
+{
+    for (int i = 0; i < NN; i++) {
+        int n = grid_char_to_int(grid_str[i]);
+        out[i] = (n == NA ? '.' : int_to_grid_char(n));
+    }
+}
+
+// a grid solved by the fast path
+static void solver_set_singles(SolveResult *result)
+{
+    // singles are deductions, the solution is unique
+    result->difficulty = kClassSingles;
+    result->status = kSolveSolved;
+    result->validated_size = NN;
+    result->solution_cnt = 1;
+}
+
+int solver_solve(Solver *solver, const char *grid_str, char out[NN + 1], SolveResult *result)
+{
+    int64_t start = timing_now_ns();
+    solver_start(solver, result, start, out);
+    solver->grid_saved = 0;
+
+    result->clues = grid_check_str(grid_str);
+    if (result->clues == NA) {
+        result->status = kSolveMalformed;
+        return 0;
+    }
+
+    // fast path : singles only with bitmasks, the engines are only used for the residual
+    int placed_size = bgrid_populate(&solver->bit_grid, grid_str);
+    if (placed_size != NA) {
+        placed_size = bgrid_solve_singles(&solver->bit_grid);
+    }
+    if (placed_size == NA) {
+        // clues in conflict or a contradiction found by the singles, out keeps the clues
+        solver_put_clues(grid_str, out);
+        result->difficulty = kClassInvalid;
+        result->status = kSolveInvalid;
+        result->residual = NN - result->clues;
+        solver_done(solver, result, start);
+        return 0;
+    }
+    result->residual = NN - placed_size;
+    if (placed_size == NN) {
+        bgrid_get_grid_str(&solver->bit_grid, out);
+        solver_set_singles(result);
+        solver_done(solver, result, start);
+        return 0;
+    }
+    bgrid_get_grid_str(&solver->bit_grid, solver->residual_str);
+
+    // the grids the singles do not solve are worth their canonical form
+    if (solver->cache.capacity > 0) {
+        const CacheValue *value = solver_cache_find(solver, grid_str, result);
+        if (value) {
+            solver_cache_get(solver, value, out, result);
+            solver_done(solver, result, start);
+            return 0;
+        }
+    }
+
+    // the colors left are only worth their cost if the route depends on them
+    const int *routes = solver->opts.routes;
+    int grid_ready = 0;
+    if (routes[kClassMedium] != routes[kClassHard]) {
+        GUARD(grid_copy(&solver->base_grid, &solver->grid));
+        GUARD(grid_populate(&solver->grid, solver->residual_str));
+        GUARD(grid_solve_pairs(&solver->grid));
+        result->colors = grid_color_count(&solver->grid);
+        result->difficulty = (result->colors <= solver->opts.color_threshold ? kClassMedium : kClassHard);
+        grid_ready = 1;
+    }
+    result->engine = routes[result->difficulty == NA ? kClassMedium : result->difficulty];
+
+    if (result->engine == kEngineDlx) {
+        GUARD(solver_run_dlx(solver, result, out));
+    } else {
+        GUARD(solver_run_color(solver, result, grid_ready, NULL, out));
+    }
+
+    solver_set_status(solver, result);
+    if (result->status == kSolveInvalid && !solver->opts.count_mode) {
+        solver_put_clues(grid_str, out);
+    }
+    if (solver->cache.capacity > 0) {
+        solver_cache_add(solver, out, result);
+    }
+    solver_done(solver, result, start);
+    return 0;
+}
+
+int solver_solve_batch(Solver *solver, const char *const grid_strs[], int cnt, char outs[][NN + 1],
+                       SolveResult results[])
+{
+    int64_t start = timing_now_ns();
+    // the lanes get the well formed grids, the malformed ones are reported by solver_solve
+    const char *lane_strs[kBatchLanes];
+    int lanes[kBatchLanes], lane_cnt = 0; // lane of each grid, NA for a malformed one
+    int clues[kBatchLanes];
+    for (int g = 0; g < cnt; g++) {
+        lanes[g] = NA;
+        clues[g] = grid_check_str(grid_strs[g]);
+        if (clues[g] != NA) {
+            lane_strs[lane_cnt] = grid_strs[g];
+            lanes[g] = lane_cnt++;
+        }
+    }
+    unsigned solved = 0;
+    if (lane_cnt > 0) {
+        bbatch_populate(&solver->bit_batch, lane_strs, lane_cnt);
+        solved = bbatch_solve_singles(&solver->bit_batch);
+    }
+    // each grid solved by the batch gets its share of the batch time
+    const int64_t share = (timing_now_ns() - start) / (lane_cnt > 0 ? lane_cnt : 1);
+    for (int g = 0; g < cnt; g++) {
+        if (lanes[g] == NA || !(solved >> lanes[g] & 1)) {
+            GUARD(solver_solve(solver, grid_strs[g], outs[g], &results[g]));
+            continue;
+        }
+        start = timing_now_ns() - share;
+        solver_start(solver, &results[g], start, outs[g]);
+        solver->grid_saved = 0;
+        results[g].clues = clues[g];
+        bbatch_get_grid_str(&solver->bit_batch, lanes[g], outs[g]);
+        solver_set_singles(&results[g]);
+        solver_done(solver, &results[g], start);
+    }
+    return 0;
+}
+
+long solver_save(const Solver *solver, uint8_t *blob, long size)
+{
+    if (!solver->grid_saved || solver->grid.invalid) {
+        return NA;
+    }
+    return grid_save(&solver->grid, blob, size);
+}
+
+int solver_resume(Solver *solver, const uint8_t *blob, long size, char out[NN + 1], SolveResult *result)
+{
+    int64_t start = timing_now_ns();
+    solver_start(solver, result, start, out);
+    solver->grid_saved = 0;
+    GUARD(grid_load(&solver->grid, blob, size));
+    grid_set_stages(&solver->grid, solver->opts.stage_mask, solver->opts.adaptive);
+    grid_set_perf(&solver->grid, solver->perf_enabled ? &solver->perf : NULL);
+    grid_set_limits(&solver->grid, &solver->limits);
+    // the stats of the solve before the state was saved are not counted twice
+    StageStats base[kStageCount];
+    memcpy(base, solver->grid.stage_stats, sizeof(base));
+
+    const int engine = solver->opts.routes[kClassHard];
+    result->engine = (engine == kEngineDlx ? kEngineColorSearch : engine);
+    result->residual = NN - solver->grid.validated_size;
+    GUARD(solver_run_color(solver, result, 1, base, out));
+
+    solver_set_status(solver, result);
+    solver_done(solver, result, start);
+    return 0;
+}
@@ -0,0 +1,176 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include "bitbatch.h"
+#include "bitgrid.h"
+#include "cache.h"
+#include "canon.h"
+#include "consts.h"
+#include "dlx.h"
+#include "grid.h"
+#include "search.h"
+
+/*
+ * Summary:
+ *
+ * Dispatcher in front of the engines, one grid string in, one result out.
+ *
+ * The difficulty is estimated cheaply, cheapest first :
+ * - the singles fast path (bitgrid.c, or bitbatch.c for a batch of grids), a grid it solves is done
+ * - the residual after the singles
+ * - the colors left after the first round of grid_solve (grid_solve_pairs), only computed
+ *   when the medium and hard classes are not routed to the same engine
+ * then each class is routed to an engine : the color solver, the color solver with the
+ * search fallback, or dlx.
+ * With a cache, the grids the singles do not solve are looked up by their canonical form first,
+ * and the solved ones, the final counts in count mode, are added to it.
+ */
+
+// difficulty class
+enum {
+    kClassSingles = 0, // solved by the fast path
+    kClassMedium = 1, // colors left after the first round <= color_threshold
+    kClassHard = 2, // else
+    kClassInvalid = 3, // clues in conflict or a contradiction found by the fast path
+    kClassCount = 4
+};
+
+// engine
+enum {
+    kEngineSingles = 0, // fast path only
+    kEngineColor = 1, // grid_solve
+    kEngineColorSearch = 2, // grid_solve then the search if needed
+    kEngineDlx = 3, // Dancing Links
+    kEngineCount = 4
+};
+
+// result status
+enum {
+    kSolveMalformed = 0, // not a grid string, see grid_check_str
+    kSolveInvalid = 1, // no solution found as the grid is invalid
+    kSolveUnsolved = 2, // partial solution only
+    kSolveSolved = 3
+};
+
+typedef struct
+{
+    int routes[kClassCount]; // engine by class, kClassSingles and kClassInvalid are not routed
+    int color_threshold; // colors left after the first round above which a grid is hard
+    long search_limit; // max number of branches by grid for the search and for dlx, 0 for no limit
+    int count_mode; // count the solutions instead of solving
+    int count_limit; // stop counting at count_limit
+    unsigned stage_mask; // grid_solve stages enabled, see grid_set_stages
+    int adaptive; // grid_solve adaptive scheduling
+    int perf; // hardware counters by grid_solve stage, see perf.h
+    FILE *route_log; // if not NULL, one line by grid with the routing decision
+    long deadline_us; // time by grid for grid_solve, the search and dlx, then the result is partial, 0 for no limit
+    long op_budget; // vertices by grid for the SCC and cycle searches of grid_solve, see GridLimits, 0 for no limit
+    int cache_size; // results kept by canonical form (canon.h, cache.h), 0 for no cache, the one of solver_init
+} SolverOpts;
+
+typedef struct
+{
+    int status;
+    int difficulty; // class
+    int engine; // engine used
+    int clues; // number of clues
+    int residual; // empty cells left by the fast path
+    int colors; // colors left after the first round, NA if not estimated
+    int validated_size; // as grid_solve, NN if solved
+    int solution_cnt; // count mode only, number of solutions in [0, count_limit]
+    int lower_bound; // count mode only, set if the search limit stopped the count
+    long branches; // branches of the search or of dlx
+    int timed_out; // deadline_us or op_budget stopped the solve, the status tells what was found before
+    int cache; // NA if not looked up (no cache, solved by the singles, too symmetric), else 1 for a hit, 0 for a miss
+    long canon_ns; // time of the canonical form and of the lookup
+    long ns; // time spent
+    StageStats stages[kStageCount]; // grid_solve stages, the search branches included
+#ifdef MEM_STATS
+    MemStats mem; // IntVec allocations of the solve, see mem_stats_end
+    long grid_bytes; // bytes held by the grids of the solver after the solve, see grid_mem_bytes
+    long rss_bytes; // resident set size after the solve, NA if not available
+#endif
+} SolveResult;
+
+typedef struct
+{
+    SolverOpts opts;
+    Grid base_grid; // empty grid, copied before each grid
+    Grid grid;
+    BitGrid bit_grid;
+    BitBatch bit_batch;
+    Dlx dlx; // built on first use
+    int dlx_ready;
+    GridSearch search;
+    char residual_str[NN + 1];
+    PerfCounters perf;
+    int perf_enabled; // opts.perf and the counters opened, else timings only
+    GridLimits limits; // of the grid being solved, shared by the base grid and its copies
+    int grid_saved; // grid holds the state of the last solve, see solver_save
+    ResultCache cache; // capacity 0 if no cache
+    CanonTransform canon; // of the grid being solved
+    char canon_str[NN + 1];
+    uint8_t canon_key[kPackedSize]; // canon_str packed
+#ifdef MEM_STATS
+    MemStats mem_start; // counters at the start of the solve
+#endif
+} Solver;
+
+// defaults : medium grids to the color solver, hard ones to the color solver with the search
+void solver_default_opts(SolverOpts *opts);
+// init, the Solver struct is large, don't put it on the stack
+// return NA if alloc fails
+int  solver_init(Solver *solver, const SolverOpts *opts);
+// free the allocated memory
+void solver_free(Solver *solver);
+// change the options between two grids, no alloc, the perf and cache_size options are the ones of solver_init,
+// a change of count mode or count limit drops the results cached
+void solver_set_opts(Solver *solver, const SolverOpts *opts);
+// solve or count the solutions of a grid string, out gets the solution, '.' for the positions not solved
+// return NA if alloc fails
+int  solver_solve(Solver *solver, const char *grid_str, char out[NN + 1], SolveResult *result);
+// solve or count the solutions of cnt grid strings, cnt <= kBatchLanes : the fast path of all of them at once
+// (bitbatch.h), then the grids it does not solve one by one as solver_solve. Same outs and results as cnt
+// solver_solve calls, a grid solved by the batch gets its share of the batch time
+// return NA if alloc fails
+int  solver_solve_batch(Solver *solver, const char *const grid_strs[], int cnt, char outs[][NN + 1],
+                        SolveResult results[]);
+// write the state of the color solver after the last solve in blob, as grid_save : a grid stopped by the deadline
+// or the op budget is parked there, to be resumed later or on another machine
+// return NA if the last solve did not use the color solver or found the grid invalid, else the size of the state
+long solver_save(const Solver *solver, uint8_t *blob, long size);
+// go on with a state written by solver_save, with the current options and the engine of the hard class,
+// the color solver with the search if that engine is dlx : the deductions saved are kept, a search cut short
+// restarts from the saved grid. The grid is not rated again, the class is NA
+// return NA if alloc fails or if blob is not a state of this build, see grid_load
+int  solver_resume(Solver *solver, const uint8_t *blob, long size, char out[NN + 1], SolveResult *result);
+// the routing decision of a result, one line, the format of opts.route_log
+void solver_print_route(FILE *f, const SolveResult *result);
+// name of a class or of an engine, for logs and command line
+const char *solver_class_name(int difficulty);
+const char *solver_engine_name(int engine);
+// return the engine with that name or NA
+int  solver_engine_from_name(const char *name);
+// return the class with that name or NA
+int  solver_class_from_name(const char *name);
+
+#endif // SOLVER_H
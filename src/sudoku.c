@@ -0,0 +1,150 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sudoku.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "solver.h"
+
+struct SudokuCtx
+{
+    Solver solver;
+    SolveResult last;
+};
+
+// solver.h values to sudoku.h ones
+static const int kStatuses[] = { kSudokuMalformed, kSudokuInvalid, kSudokuUnsolved, kSudokuSolved };
+static const int kClasses[kClassCount] = {
+    kSudokuClassSingles, kSudokuClassMedium, kSudokuClassHard, kSudokuClassInvalid
+};
+static const int kEngines[] = { NA, kEngineColor, kEngineColorSearch, kEngineDlx };
+
+int sudoku_cells(void)
+{
+    return NN;
+}
+
+void sudoku_default_opts(SudokuOpts *opts)
+{
+    opts->engine = kSudokuEngineAuto;
+    opts->search = 0;
+    opts->search_limit = 0;
+    opts->count_limit = 0;
+    opts->adaptive = 0;
+    opts->deadline_us = 0;
+    opts->op_budget = 0;
+}
+
+// nothing solved yet, or the last request failed before the solve
+static void sudoku_reset_last(SudokuCtx *ctx)
+{
+    memset(&ctx->last, 0, sizeof(ctx->last));
+    ctx->last.difficulty = NA;
+}
+
+SudokuCtx *sudoku_ctx_create(void)
+{
+    SudokuCtx *ctx = malloc(sizeof(SudokuCtx));
+    if (!ctx) {
+        return NULL;
+    }
+    SolverOpts opts;
+    solver_default_opts(&opts);
+    if (solver_init(&ctx->solver, &opts) == NA) {
+        free(ctx);
+        return NULL;
+    }
+    sudoku_reset_last(ctx);
+    return ctx;
+}
+
+// return NA if an option is out of its range
+static int sudoku_set_opts(SudokuCtx *ctx, const SudokuOpts *sopts)
+{
+    if (sopts->engine < kSudokuEngineAuto || sopts->engine > kSudokuEngineDlx
+            || sopts->search_limit < 0 || sopts->count_limit < 0 || sopts->deadline_us < 0 || sopts->op_budget < 0) {
+        return NA;
+    }
+    SolverOpts opts;
+    solver_default_opts(&opts);
+    if (sopts->engine != kSudokuEngineAuto) {
+        opts.routes[kClassMedium] = opts.routes[kClassHard] = kEngines[sopts->engine];
+    }
+    if (sopts->search) {
+        for (int c = kClassMedium; c <= kClassHard; c++) {
+            if (opts.routes[c] == kEngineColor) {
+                opts.routes[c] = kEngineColorSearch;
+            }
+        }
+    }
+    opts.search_limit = sopts->search_limit;
+    opts.count_mode = (sopts->count_limit > 0);
+    opts.count_limit = (sopts->count_limit > 0 ? sopts->count_limit : opts.count_limit);
+    opts.adaptive = sopts->adaptive;
+    opts.deadline_us = sopts->deadline_us;
+    opts.op_budget = sopts->op_budget;
+    solver_set_opts(&ctx->solver, &opts);
+    return 0;
+}
+
+int sudoku_solve(SudokuCtx *ctx, const char *in, char *out, const SudokuOpts *opts)
+{
+    sudoku_reset_last(ctx);
+    SudokuOpts defaults;
+    if (!opts) {
+        sudoku_default_opts(&defaults);
+        opts = &defaults;
+    }
+    if (sudoku_set_opts(ctx, opts) == NA) {
+        return kSudokuBadOpts;
+    }
+    if (!in) {
+        return kSudokuMalformed;
+    }
+    if (solver_solve(&ctx->solver, in, out, &ctx->last) == NA) {
+        sudoku_reset_last(ctx);
+        return kSudokuNoMemory;
+    }
+    if (ctx->last.timed_out && ctx->last.status != kSolveSolved) {
+        return kSudokuTimedOut;
+    }
+    return kStatuses[ctx->last.status];
+}
+
+void sudoku_last_info(const SudokuCtx *ctx, SudokuInfo *info)
+{
+    const SolveResult *last = &ctx->last;
+    info->difficulty = (last->difficulty == NA ? kSudokuClassUnknown : kClasses[last->difficulty]);
+    info->solutions = last->solution_cnt;
+    info->lower_bound = last->lower_bound;
+    info->branches = last->branches;
+    info->timed_out = last->timed_out;
+    info->ns = last->ns;
+}
+
+void sudoku_ctx_destroy(SudokuCtx *ctx)
+{
+    if (!ctx) {
+        return;
+    }
+    solver_free(&ctx->solver);
+    free(ctx);
+}
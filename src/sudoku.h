@@ -0,0 +1,108 @@
+
+/*
+ * This code is part of rSudokuSolver
+ * Copyright (C) 2016 rafirafi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SUDOKU_H
+#define SUDOKU_H
+
+/*
+ * Summary:
+ *
+ * Library API, the entry point for the programs linking the solver instead of running rSudokuSolver.
+ * Nothing of the solver internals is needed : no Grid, no base grid to copy, no NA convention.
+ *
+ * A context owns a Solver (solver.h) and the memory of all its grids : create it once, solve any number
+ * of grid strings with it, destroy it. The containers of a context keep their capacity from one grid
+ * to the next, once they fit the grids solved a context does not allocate anymore.
+ * A context is used by one thread at a time and the contexts share nothing : one context by thread is safe.
+ * The grid size is the one of the build, see D in consts.h and sudoku_cells.
+ *
+ *  SudokuCtx *ctx = sudoku_ctx_create();
+ *  char out[81 + 1];
+ *  if (ctx && sudoku_solve(ctx, grid_str, out, NULL) == kSudokuSolved) {
+ *      puts(out);
+ *  }
+ *  sudoku_ctx_destroy(ctx);
+ */
+
+// status returned by sudoku_solve
+enum {
+    kSudokuSolved = 0, // out is the solution, in count mode at least one solution was found
+    kSudokuUnsolved = 1, // out is a partial solution, '.' for the cells not solved
+    kSudokuInvalid = 2, // no solution, out keeps the clues
+    kSudokuMalformed = 3, // not a grid string of sudoku_cells characters, or a 9x9 grid with less than 17 clues
+    kSudokuBadOpts = 4, // an option out of its range
+    kSudokuNoMemory = 5, // alloc failed, the context stays usable
+    kSudokuTimedOut = 6 // deadline_us or op_budget passed before a solution, out is a partial solution
+};
+
+// engine for the grids the singles do not solve
+enum {
+    kSudokuEngineAuto = 0, // rated : the medium grids to the color solver, the hard ones to the color solver and the search
+    kSudokuEngineColor = 1, // color solver only, may leave a grid unsolved
+    kSudokuEngineColorSearch = 2, // color solver, then the search if needed
+    kSudokuEngineDlx = 3 // Dancing Links
+};
+
+// difficulty class of a grid
+enum {
+    kSudokuClassSingles = 0, // solved by naked and hidden singles
+    kSudokuClassMedium = 1,
+    kSudokuClassHard = 2,
+    kSudokuClassInvalid = 3, // clues in conflict or a contradiction found by the singles
+    kSudokuClassUnknown = 4 // not rated : malformed, or an engine chosen instead of kSudokuEngineAuto
+};
+
+typedef struct
+{
+    int engine; // default kSudokuEngineAuto
+    int search; // finish with the search the grids the color solver can not, default 0
+    long search_limit; // max number of branches by grid for the search or dlx, default 0 for no limit
+    int count_limit; // 0 to solve, else count the solutions up to count_limit, default 0
+    int adaptive; // grid_solve adaptive scheduling, default 0
+    long deadline_us; // time by grid, default 0 for no limit
+    long op_budget; // vertices visited by the searches of the color solver by grid, default 0 for no limit
+} SudokuOpts;
+
+// details of the last sudoku_solve of a context
+typedef struct
+{
+    int difficulty; // class
+    int solutions; // count mode only, number of solutions in [0, count_limit]
+    int lower_bound; // count mode only, set if search_limit stopped the count
+    long branches; // branches of the search or of dlx
+    int timed_out; // the deadline or the budget stopped the solve
+    long ns; // time spent
+} SudokuInfo;
+
+typedef struct SudokuCtx SudokuCtx;
+
+// number of cells of a grid in this build, out must have room for sudoku_cells() + 1 characters
+int  sudoku_cells(void);
+void sudoku_default_opts(SudokuOpts *opts);
+// return a new context, NULL if alloc fails
+SudokuCtx *sudoku_ctx_create(void);
+// solve or count the solutions of a grid string, out gets the solution, opts NULL for the defaults
+// return the status
+int  sudoku_solve(SudokuCtx *ctx, const char *in, char *out, const SudokuOpts *opts);
+// zeros and kSudokuClassUnknown before the first solve or after a request failed before solving
+void sudoku_last_info(const SudokuCtx *ctx, SudokuInfo *info);
+// free the context, ctx may be NULL
+void sudoku_ctx_destroy(SudokuCtx *ctx);
+
+#endif // SUDOKU_H